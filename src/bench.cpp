@@ -0,0 +1,386 @@
+// SPDX-License-Identifier: MIT
+// Level generation and solving benchmark.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "clock.hpp"
+#include "level.hpp"
+#include "solver.hpp"
+
+/** Number of levels used in frame update test. */
+static constexpr size_t frame_levels = 10;
+/** Frame duration in ms (60 fps). */
+static constexpr uint64_t frame_time = 1000 / 60;
+
+/** Benchmark result for a single level configuration. */
+struct Result {
+    size_t size;                   ///< Level size (width and height)
+    bool wrap;                     ///< Wrap mode flag
+    std::vector<uint64_t> latency; ///< Time of each iteration in ns
+    uint64_t digest;               ///< Checksum of all produced states
+    size_t failures = 0;           ///< Number of failed iterations
+};
+
+/**
+ * Update FNV-1a hash.
+ * @param hash current hash value
+ * @param data pointer to the data to hash
+ * @param size size of the data in bytes
+ * @return new hash value
+ */
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= ptr[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * Generate levels and measure time.
+ * @param size level size
+ * @param wrap wrap mode flag
+ * @param first_id id of the first level
+ * @param count total number of levels to generate
+ * @return benchmark result
+ */
+static Result run(size_t size, bool wrap, uint32_t first_id, size_t count)
+{
+    Result res;
+    res.size = size;
+    res.wrap = wrap;
+    res.latency.reserve(count);
+    res.digest = 0xcbf29ce484222325ULL;
+
+    Level level;
+    level.width = size;
+    level.height = size;
+    level.wrap = wrap;
+
+    for (size_t i = 0; i < count; ++i) {
+        level.id = first_id + i;
+
+        const auto start = std::chrono::steady_clock::now();
+        level.generate();
+        const auto end = std::chrono::steady_clock::now();
+
+        res.latency.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                .count());
+
+        // the digest is used to check that levels are stable across changes
+        const std::string dump = level.save();
+        res.digest = fnv1a(res.digest, dump.data(), dump.size());
+        res.digest = fnv1a(res.digest, &level.sender, sizeof(level.sender));
+        res.digest =
+            fnv1a(res.digest, level.recievers.data(),
+                  level.recievers.size() * sizeof(level.recievers[0]));
+    }
+
+    return res;
+}
+
+/**
+ * Simulate game frames: rotate random pipes and update level state.
+ * @param size level size
+ * @param wrap wrap mode flag
+ * @param first_id id of the first level
+ * @param frames number of frames per level
+ * @return benchmark result
+ */
+static Result run_frames(size_t size, bool wrap, uint32_t first_id,
+                         size_t frames)
+{
+    Result res;
+    res.size = size;
+    res.wrap = wrap;
+    res.latency.reserve(frames * frame_levels);
+    res.digest = 0xcbf29ce484222325ULL;
+
+    Level level;
+    level.width = size;
+    level.height = size;
+    level.wrap = wrap;
+
+    ManualClock clock;
+    uint32_t rnd = first_id; // LCG, keeps level PRNG sequence intact
+
+    for (size_t i = 0; i < frame_levels; ++i) {
+        level.id = first_id + i;
+        level.generate();
+        clock.tick();
+        level.reset(clock.now());
+        level.update(clock.now());
+
+        for (size_t frame = 0; frame < frames; ++frame) {
+            clock.advance(frame_time);
+            clock.tick();
+
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t click = 0; click < 2; ++click) {
+                rnd = rnd * 1664525 + 1013904223;
+                const size_t index = (rnd >> 8) % level.cells.size();
+                if (level.cells[index].pipe != Pipe::None) {
+                    const Position pos = { index % size, index / size };
+                    level.rotate(pos, rnd & 1, clock.now());
+                }
+            }
+            level.update(clock.now());
+            const auto end = std::chrono::steady_clock::now();
+
+            res.latency.push_back(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(end -
+                                                                     start)
+                    .count());
+        }
+
+        const std::string dump = level.save();
+        res.digest = fnv1a(res.digest, dump.data(), dump.size());
+        for (const Cell& cell : level.cells) {
+            const uint8_t active = cell.active;
+            res.digest = fnv1a(res.digest, &active, sizeof(active));
+        }
+    }
+
+    return res;
+}
+
+/**
+ * Finish all rotations in progress.
+ * @param level level to update
+ * @param now current timestamp, updated to the time of the settled state
+ */
+static void settle(Level& level, uint64_t& now)
+{
+    do {
+        now += Rotation::rotation_time;
+        level.update(now);
+    } while (level.state.rotation_active);
+}
+
+/**
+ * Solve shuffled levels and measure time, each solution is checked by
+ * applying it to the level.
+ * @param size level size
+ * @param wrap wrap mode flag
+ * @param first_id id of the first level
+ * @param count total number of levels to solve
+ * @return benchmark result
+ */
+static Result run_solver(size_t size, bool wrap, uint32_t first_id,
+                         size_t count)
+{
+    Result res;
+    res.size = size;
+    res.wrap = wrap;
+    res.latency.reserve(count);
+    res.digest = 0xcbf29ce484222325ULL;
+
+    Level level;
+    level.width = size;
+    level.height = size;
+    level.wrap = wrap;
+
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t now = 0;
+        level.id = first_id + i;
+        level.generate();
+        level.reset(now);
+        settle(level, now);
+
+        const auto start = std::chrono::steady_clock::now();
+        Solver solver(level);
+        const bool solved = solver.solve();
+        const auto end = std::chrono::steady_clock::now();
+
+        res.latency.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                .count());
+
+        if (!solved) {
+            fprintf(stderr, "Level %u (%zu, wrap %s) is not solved\n",
+                    level.id, size, wrap ? "on" : "off");
+            ++res.failures;
+            continue;
+        }
+        const std::vector<uint8_t>& turns = solver.solution();
+        res.digest = fnv1a(res.digest, turns.data(), turns.size());
+
+        // apply the solution, three turns are made as one back rotation
+        for (size_t index = 0; index < turns.size(); ++index) {
+            const Position pos = { index % size, index / size };
+            if (turns[index] == 3) {
+                level.rotate(pos, false, now);
+            } else {
+                for (uint8_t turn = 0; turn < turns[index]; ++turn) {
+                    level.rotate(pos, true, now);
+                }
+            }
+        }
+        settle(level, now);
+        if (!level.state.level_complete) {
+            fprintf(stderr, "Level %u (%zu, wrap %s): wrong solution\n",
+                    level.id, size, wrap ? "on" : "off");
+            ++res.failures;
+        }
+    }
+
+    return res;
+}
+
+/**
+ * Print benchmark result.
+ * @param res benchmark result
+ */
+static void print(Result& res)
+{
+    std::vector<uint64_t>& lat = res.latency;
+    std::sort(lat.begin(), lat.end());
+
+    uint64_t total = 0;
+    for (const uint64_t ns : lat) {
+        total += ns;
+    }
+
+    const auto percentile = [&lat](size_t pct) -> double {
+        const size_t index = (lat.size() - 1) * pct / 100;
+        return static_cast<double>(lat[index]) / 1000.0;
+    };
+    const double cells = static_cast<double>(res.size * res.size) * lat.size();
+    const double cps = total ? cells / (static_cast<double>(total) / 1e9) : 0;
+
+    printf("%2zu*%-2zu  %-4s  %7zu  %9.1f  %9.1f  %9.1f  %9.1f  %11.0f  "
+           "%016llx\n",
+           res.size, res.size, res.wrap ? "on" : "off", lat.size(),
+           percentile(50), percentile(90), percentile(99), percentile(100),
+           cps, static_cast<unsigned long long>(res.digest));
+}
+
+/** Benchmark entry point. */
+int main(int argc, char* argv[])
+{
+    size_t count = 2000;
+    size_t frames = 1000;
+    uint32_t first_id = 1;
+    size_t size = 0;
+
+    // clang-format off
+    const struct option long_opts[] = {
+        { "count",  required_argument, nullptr, 'n' },
+        { "frames", required_argument, nullptr, 'f' },
+        { "id",     required_argument, nullptr, 'i' },
+        { "size",   required_argument, nullptr, 'c' },
+        { "help",   no_argument,       nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+    const char* short_opts = "n:f:i:c:h";
+    // clang-format on
+
+    opterr = 0; // prevent native error messages
+
+    // parse arguments
+    int opt;
+    while ((opt = getopt_long(argc, argv, short_opts, long_opts, nullptr)) !=
+           -1) {
+        switch (opt) {
+            case 'n':
+                count = strtoul(optarg, nullptr, 0);
+                if (count == 0) {
+                    fprintf(stderr, "Invalid number of levels: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'f':
+                frames = strtoul(optarg, nullptr, 0);
+                if (frames == 0) {
+                    fprintf(stderr, "Invalid number of frames: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'i':
+                first_id = strtoul(optarg, nullptr, 0);
+                if (first_id <= 0 || first_id > Level::max_id) {
+                    fprintf(stderr, "Invalid level id: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'c':
+                size = strtoul(optarg, nullptr, 0);
+                if (size < Level::min_size || size > Level::max_size) {
+                    fprintf(stderr, "Invalid level size: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'h':
+                printf("Usage: %s [OPTION...]\n", argv[0]);
+                puts("  -n, --count=NUM      number of levels per test "
+                     "(default: 2000)");
+                puts("  -f, --frames=NUM     number of frames per level "
+                     "(default: 1000)");
+                puts("  -i, --id=ID          id of the first level "
+                     "(default: 1)");
+                printf("  -c, --size=SIZE      test only specified level size "
+                       "(%zu-%zu)\n",
+                       Level::min_size, Level::max_size);
+                puts("  -h, --help           print this help and exit");
+                return EXIT_SUCCESS;
+            default:
+                fprintf(stderr, "Invalid argument: %s\n", argv[optind - 1]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (first_id + count - 1 > Level::max_id) {
+        count = Level::max_id - first_id + 1;
+    }
+
+    std::vector<size_t> sizes;
+    if (size) {
+        sizes.push_back(size);
+    } else {
+        sizes.assign(Level::sizes, Level::sizes + Level::sizes_num);
+    }
+
+    puts("Level generation:");
+    puts("size   wrap   levels     p50,us     p90,us     p99,us     max,us  "
+         "    cells/s  digest");
+    for (const size_t sz : sizes) {
+        for (const bool wrap : { true, false }) {
+            Result res = run(sz, wrap, first_id, count);
+            print(res);
+        }
+    }
+
+    puts("Frame update (virtual clock):");
+    puts("size   wrap   frames     p50,us     p90,us     p99,us     max,us  "
+         "    cells/s  digest");
+    for (const size_t sz : sizes) {
+        for (const bool wrap : { true, false }) {
+            Result res = run_frames(sz, wrap, first_id, frames);
+            print(res);
+        }
+    }
+
+    puts("Level solving:");
+    puts("size   wrap   levels     p50,us     p90,us     p99,us     max,us  "
+         "    cells/s  digest");
+    size_t failures = 0;
+    for (const size_t sz : sizes) {
+        for (const bool wrap : { true, false }) {
+            Result res = run_solver(sz, wrap, first_id, count);
+            print(res);
+            failures += res.failures;
+        }
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,258 @@
+// SPDX-License-Identifier: MIT
+// Alpha blending kernels for the software renderer.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "blend.hpp"
+
+#if defined(__SSE2__)
+#define BLEND_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define BLEND_AVX2
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON)
+#define BLEND_NEON
+#include <arm_neon.h>
+#endif
+
+/** Alpha mask of ARGB pixel. */
+static constexpr uint32_t alpha_mask = 0xff000000;
+
+/**
+ * Divide by 255 with rounding, exact for [0, 255*255].
+ * @param x dividend
+ * @return quotient
+ */
+static inline uint32_t div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+void blend_scalar(uint32_t* dst, const uint32_t* src, size_t count,
+                  uint32_t color)
+{
+    const uint32_t mod_a = color >> 24;
+    const uint32_t mod_r = (color >> 16) & 0xff;
+    const uint32_t mod_g = (color >> 8) & 0xff;
+    const uint32_t mod_b = color & 0xff;
+
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t s = src[i];
+        const uint32_t a = div255((s >> 24) * mod_a);
+        if (!a) {
+            continue; // transparent
+        }
+        const uint32_t ia = 0xff - a;
+        const uint32_t r = div255(((s >> 16) & 0xff) * mod_r);
+        const uint32_t g = div255(((s >> 8) & 0xff) * mod_g);
+        const uint32_t b = div255((s & 0xff) * mod_b);
+
+        const uint32_t d = dst[i];
+        const uint32_t dr = (d >> 16) & 0xff;
+        const uint32_t dg = (d >> 8) & 0xff;
+        const uint32_t db = d & 0xff;
+
+        dst[i] = alpha_mask | (div255(r * a + dr * ia) << 16) |
+            (div255(g * a + dg * ia) << 8) | div255(b * a + db * ia);
+    }
+}
+
+#ifdef BLEND_SSE2
+/**
+ * Divide 16-bit lanes by 255 with rounding.
+ * @param x dividend
+ * @return quotient
+ */
+static inline __m128i div255_sse2(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/**
+ * Blend two pixels unpacked to 16-bit lanes.
+ * @param s source pixels
+ * @param d destination pixels
+ * @param mod modulation color
+ * @return blended pixels
+ */
+static inline __m128i blend2_sse2(__m128i s, __m128i d, __m128i mod)
+{
+    s = div255_sse2(_mm_mullo_epi16(s, mod));
+    const __m128i a =
+        _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+    const __m128i ia = _mm_sub_epi16(_mm_set1_epi16(0xff), a);
+    return div255_sse2(
+        _mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, ia)));
+}
+
+/** SSE2 version of blend(): 4 pixels per iteration. */
+static void blend_sse2(uint32_t* dst, const uint32_t* src, size_t count,
+                       uint32_t color)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32(alpha_mask);
+    const __m128i mod =
+        _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(color)), zero);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i transparent =
+            _mm_cmpeq_epi32(_mm_and_si128(s, opaque), zero);
+        if (_mm_movemask_epi8(transparent) == 0xffff) {
+            continue;
+        }
+        __m128i* out = reinterpret_cast<__m128i*>(dst + i);
+        const __m128i d = _mm_loadu_si128(out);
+        const __m128i lo = blend2_sse2(_mm_unpacklo_epi8(s, zero),
+                                       _mm_unpacklo_epi8(d, zero), mod);
+        const __m128i hi = blend2_sse2(_mm_unpackhi_epi8(s, zero),
+                                       _mm_unpackhi_epi8(d, zero), mod);
+        _mm_storeu_si128(out, _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+
+    blend_scalar(dst + i, src + i, count - i, color);
+}
+#endif // BLEND_SSE2
+
+#ifdef BLEND_AVX2
+/**
+ * Divide 16-bit lanes by 255 with rounding.
+ * @param x dividend
+ * @return quotient
+ */
+__attribute__((target("avx2"))) static inline __m256i div255_avx2(__m256i x)
+{
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+/**
+ * Blend four pixels unpacked to 16-bit lanes.
+ * @param s source pixels
+ * @param d destination pixels
+ * @param mod modulation color
+ * @return blended pixels
+ */
+__attribute__((target("avx2"))) static inline __m256i
+blend4_avx2(__m256i s, __m256i d, __m256i mod)
+{
+    s = div255_avx2(_mm256_mullo_epi16(s, mod));
+    const __m256i a =
+        _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xff), 0xff);
+    const __m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(0xff), a);
+    return div255_avx2(
+        _mm256_add_epi16(_mm256_mullo_epi16(s, a), _mm256_mullo_epi16(d, ia)));
+}
+
+/** AVX2 version of blend(): 8 pixels per iteration. */
+__attribute__((target("avx2"))) static void
+blend_avx2(uint32_t* dst, const uint32_t* src, size_t count, uint32_t color)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i opaque = _mm256_set1_epi32(alpha_mask);
+    const __m256i mod = _mm256_unpacklo_epi8(
+        _mm256_set1_epi32(static_cast<int>(color)), zero);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i s =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        const __m256i transparent =
+            _mm256_cmpeq_epi32(_mm256_and_si256(s, opaque), zero);
+        if (_mm256_movemask_epi8(transparent) == -1) {
+            continue;
+        }
+        __m256i* out = reinterpret_cast<__m256i*>(dst + i);
+        const __m256i d = _mm256_loadu_si256(out);
+        const __m256i lo = blend4_avx2(_mm256_unpacklo_epi8(s, zero),
+                                       _mm256_unpacklo_epi8(d, zero), mod);
+        const __m256i hi = blend4_avx2(_mm256_unpackhi_epi8(s, zero),
+                                       _mm256_unpackhi_epi8(d, zero), mod);
+        _mm256_storeu_si256(
+            out, _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+    }
+
+    blend_sse2(dst + i, src + i, count - i, color);
+}
+#endif // BLEND_AVX2
+
+#ifdef BLEND_NEON
+/**
+ * Multiply 8-bit lanes and divide by 255 with rounding.
+ * @param x,y multipliers
+ * @return result
+ */
+static inline uint8x8_t mul255_neon(uint8x8_t x, uint8x8_t y)
+{
+    const uint16x8_t t = vaddq_u16(vmull_u8(x, y), vdupq_n_u16(128));
+    return vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+}
+
+/** NEON version of blend(): 8 pixels per iteration. */
+static void blend_neon(uint32_t* dst, const uint32_t* src, size_t count,
+                       uint32_t color)
+{
+    // ARGB pixels in little endian memory: B, G, R, A
+    const uint8x8_t mod[] = { vdup_n_u8(color & 0xff),
+                              vdup_n_u8((color >> 8) & 0xff),
+                              vdup_n_u8((color >> 16) & 0xff),
+                              vdup_n_u8(color >> 24) };
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const uint8x8x4_t s =
+            vld4_u8(reinterpret_cast<const uint8_t*>(src + i));
+        if (!vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0)) {
+            continue; // transparent
+        }
+        uint8_t* out = reinterpret_cast<uint8_t*>(dst + i);
+        uint8x8x4_t d = vld4_u8(out);
+        const uint8x8_t a = mul255_neon(s.val[3], mod[3]);
+        const uint8x8_t ia = vmvn_u8(a);
+        for (size_t c = 0; c < 3; ++c) {
+            const uint8x8_t sc = mul255_neon(s.val[c], mod[c]);
+            const uint16x8_t t = vaddq_u16(
+                vmlal_u8(vmull_u8(sc, a), d.val[c], ia), vdupq_n_u16(128));
+            d.val[c] = vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+        }
+        d.val[3] = vdup_n_u8(0xff);
+        vst4_u8(out, d);
+    }
+
+    blend_scalar(dst + i, src + i, count - i, color);
+}
+#endif // BLEND_NEON
+
+/** Pointer to blend function. */
+using BlendFunc = void (*)(uint32_t*, const uint32_t*, size_t, uint32_t);
+
+/**
+ * Select the best blend function for the current CPU.
+ * @return pointer to blend function
+ */
+static BlendFunc select_blend()
+{
+#if defined(BLEND_AVX2)
+    if (__builtin_cpu_supports("avx2")) {
+        return blend_avx2;
+    }
+#endif
+#if defined(BLEND_SSE2)
+    return blend_sse2;
+#elif defined(BLEND_NEON)
+    return blend_neon;
+#else
+    return blend_scalar;
+#endif
+}
+
+void blend(uint32_t* dst, const uint32_t* src, size_t count, uint32_t color)
+{
+    static const BlendFunc func = select_blend();
+    func(dst, src, count, color);
+}
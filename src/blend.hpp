@@ -0,0 +1,29 @@
+// SPDX-License-Identifier: MIT
+// Alpha blending kernels for the software renderer.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Blend source pixels over destination pixels, same as SDL_BLENDMODE_BLEND
+ * with color/alpha modulation. Uses SIMD instructions if available, the
+ * result is the same as for the scalar version.
+ * @param dst destination pixels (ARGB), result is always opaque
+ * @param src source pixels (ARGB, not premultiplied)
+ * @param count number of pixels to blend
+ * @param color modulation color (ARGB)
+ */
+void blend(uint32_t* dst, const uint32_t* src, size_t count, uint32_t color);
+
+/**
+ * Scalar version of blend(), used for tails and as a fallback.
+ * @param dst destination pixels (ARGB), result is always opaque
+ * @param src source pixels (ARGB, not premultiplied)
+ * @param count number of pixels to blend
+ * @param color modulation color (ARGB)
+ */
+void blend_scalar(uint32_t* dst, const uint32_t* src, size_t count,
+                  uint32_t color);
@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: MIT
+// Canvas: image buffer for the software renderer.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "canvas.hpp"
+
+#include "blend.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+Canvas::Canvas()
+    : width(0)
+    , height(0)
+{
+}
+
+bool Canvas::load(SDL_Surface* surface)
+{
+    SDL_Surface* argb =
+        SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+    if (!argb) {
+        return false;
+    }
+
+    resize(argb->w, argb->h);
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* src =
+            reinterpret_cast<const uint8_t*>(argb->pixels) + y * argb->pitch;
+        memcpy(&pixels[y * width], src, width * sizeof(uint32_t));
+    }
+
+    SDL_FreeSurface(argb);
+    return true;
+}
+
+void Canvas::resize(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    pixels.resize(width * height);
+}
+
+void Canvas::fill(uint32_t color)
+{
+    std::fill(pixels.begin(), pixels.end(), color);
+}
+
+bool Canvas::copy(const Canvas& src)
+{
+    if (src.width == width && src.height == height) {
+        pixels = src.pixels;
+        return true;
+    }
+
+    const int w = std::min(width, src.width);
+    const int h = std::min(height, src.height);
+    for (int y = 0; y < h; ++y) {
+        memcpy(&pixels[y * width], &src.pixels[y * src.width],
+               w * sizeof(uint32_t));
+    }
+    return false;
+}
+
+void Canvas::draw(const Canvas& image, const SDL_Rect& src,
+                  const SDL_Rect& dst, double angle, uint32_t color,
+                  const SDL_Rect* clip)
+{
+    if (src.w <= 0 || src.h <= 0 || dst.w <= 0 || dst.h <= 0) {
+        return;
+    }
+
+    // size of destination pixel in the source image, 16.16 fixed point
+    const int64_t step_x = (static_cast<int64_t>(src.w) << 16) / dst.w;
+    const int64_t step_y = (static_cast<int64_t>(src.h) << 16) / dst.h;
+
+    // inverse mapping: source coordinates of the pixel (x,y) inside the
+    // bounding box are (u0 + x * du_x + y * du_y, v0 + x * dv_x + y * dv_y)
+    SDL_Rect box;
+    int64_t u0, du_x, du_y, v0, dv_x, dv_y;
+    bool inside; // all mapped pixels are inside the source rectangle
+
+    int turns = static_cast<int>(angle) / 90;
+    if (turns * 90 == angle) {
+        // rotation by multiple of 90 degrees, integer only
+        inside = true;
+        turns %= 4;
+        if (turns < 0) {
+            turns += 4;
+        }
+        box = dst;
+        if (turns & 1) {
+            box.x += (dst.w - dst.h) / 2;
+            box.y += (dst.h - dst.w) / 2;
+            box.w = dst.h;
+            box.h = dst.w;
+        }
+        const int64_t first_x = step_x / 2;
+        const int64_t first_y = step_y / 2;
+        const int64_t last_x = dst.w * step_x - first_x;
+        const int64_t last_y = dst.h * step_y - first_y;
+        switch (turns) {
+            case 0:
+                u0 = first_x;
+                du_x = step_x;
+                du_y = 0;
+                v0 = first_y;
+                dv_x = 0;
+                dv_y = step_y;
+                break;
+            case 1:
+                u0 = first_x;
+                du_x = 0;
+                du_y = step_x;
+                v0 = last_y;
+                dv_x = -step_y;
+                dv_y = 0;
+                break;
+            case 2:
+                u0 = last_x;
+                du_x = -step_x;
+                du_y = 0;
+                v0 = last_y;
+                dv_x = 0;
+                dv_y = -step_y;
+                break;
+            default:
+                u0 = last_x;
+                du_x = 0;
+                du_y = -step_x;
+                v0 = first_y;
+                dv_x = step_y;
+                dv_y = 0;
+                break;
+        }
+    } else {
+        // arbitrary angle, check bounds for each pixel
+        inside = false;
+        const double rad = angle * M_PI / 180;
+        const double cos_a = cos(rad);
+        const double sin_a = sin(rad);
+        const double half_w = static_cast<double>(dst.w) / 2;
+        const double half_h = static_cast<double>(dst.h) / 2;
+        const double center_x = dst.x + half_w;
+        const double center_y = dst.y + half_h;
+        const double ext_x = fabs(half_w * cos_a) + fabs(half_h * sin_a);
+        const double ext_y = fabs(half_w * sin_a) + fabs(half_h * cos_a);
+        box.x = floor(center_x - ext_x);
+        box.y = floor(center_y - ext_y);
+        box.w = static_cast<int>(ceil(center_x + ext_x)) - box.x;
+        box.h = static_cast<int>(ceil(center_y + ext_y)) - box.y;
+
+        // rotate center of the first pixel back
+        const double px = box.x + 0.5 - center_x;
+        const double py = box.y + 0.5 - center_y;
+        const double lx = px * cos_a + py * sin_a + half_w;
+        const double ly = -px * sin_a + py * cos_a + half_h;
+        u0 = lx * step_x;
+        du_x = cos_a * step_x;
+        du_y = sin_a * step_x;
+        v0 = ly * step_y;
+        dv_x = -sin_a * step_y;
+        dv_y = cos_a * step_y;
+    }
+
+    // visible part of the bounding box
+    SDL_Rect area = { 0, 0, width, height };
+    if ((clip && !SDL_IntersectRect(&area, clip, &area)) ||
+        !SDL_IntersectRect(&area, &box, &area)) {
+        return;
+    }
+    const int64_t skip_x = area.x - box.x;
+    const int64_t skip_y = area.y - box.y;
+    int64_t row_u = u0 + skip_x * du_x + skip_y * du_y;
+    int64_t row_v = v0 + skip_x * dv_x + skip_y * dv_y;
+
+    const int64_t max_u = static_cast<int64_t>(src.w) << 16;
+    const int64_t max_v = static_cast<int64_t>(src.h) << 16;
+    const uint32_t* img = &image.pixels[src.y * image.width + src.x];
+
+    line.resize(area.w);
+    for (int y = 0; y < area.h; ++y) {
+        // gather source pixels of the line
+        int64_t u = row_u;
+        int64_t v = row_v;
+        for (int x = 0; x < area.w; ++x) {
+            if (inside || (u >= 0 && v >= 0 && u < max_u && v < max_v)) {
+                line[x] = img[(v >> 16) * image.width + (u >> 16)];
+            } else {
+                line[x] = 0;
+            }
+            u += du_x;
+            v += dv_x;
+        }
+        row_u += du_y;
+        row_v += dv_y;
+
+        blend(&pixels[(area.y + y) * width + area.x], line.data(), area.w,
+              color);
+    }
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: MIT
+// Canvas: image buffer for the software renderer.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <cstdint>
+#include <vector>
+
+/** Canvas: ARGB image buffer with CPU compositing. */
+class Canvas {
+public:
+    /** Constructor. */
+    Canvas();
+
+    /**
+     * Load pixels from surface.
+     * @param surface source image
+     * @return false if something went wrong
+     */
+    bool load(SDL_Surface* surface);
+
+    /**
+     * Change canvas size, content becomes undefined.
+     * @param width,height new size in px
+     */
+    void resize(int width, int height);
+
+    /**
+     * Fill the whole canvas with specified color.
+     * @param color fill color (ARGB)
+     */
+    void fill(uint32_t color);
+
+    /**
+     * Copy pixels from other canvas, only the common area is copied if the
+     * sizes are different.
+     * @param src source canvas
+     * @return false if canvas sizes are different
+     */
+    bool copy(const Canvas& src);
+
+    /**
+     * Draw part of the image: scale, rotate and blend it over the canvas.
+     * @param image source image
+     * @param src source rectangle inside the image
+     * @param dst destination position and size (before rotation)
+     * @param angle rotation angle in degrees (clockwise)
+     * @param color color and transparency modulation (ARGB)
+     * @param clip clip rectangle, nullptr to draw on the whole canvas
+     */
+    void draw(const Canvas& image, const SDL_Rect& src, const SDL_Rect& dst,
+              double angle, uint32_t color, const SDL_Rect* clip);
+
+    int width;                    ///< Canvas width in px
+    int height;                   ///< Canvas height in px
+    std::vector<uint32_t> pixels; ///< Pixel data (ARGB)
+
+private:
+    std::vector<uint32_t> line; ///< Source pixels of the current line
+};
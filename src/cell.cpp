@@ -4,7 +4,31 @@
 
 #include "cell.hpp"
 
-#include <SDL2/SDL.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/**
+ * Get index of the lowest set bit.
+ * @param mask bit mask, must not be zero
+ * @return index of the lowest set bit
+ */
+static inline unsigned int lowest_bit(uint8_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    unsigned int index = 0;
+    for (; !(mask & 1); mask >>= 1) {
+        ++index;
+    }
+    return index;
+#endif
+}
 
 bool Position::operator==(const Position& other) const
 {
@@ -41,40 +65,76 @@ Side::operator Type() const
     return side;
 }
 
+Sides::Iterator::Iterator(uint8_t mask)
+    : mask(mask)
+{
+}
+
+Side Sides::Iterator::operator*() const
+{
+    return static_cast<Side::Type>(lowest_bit(mask));
+}
+
+Sides::Iterator& Sides::Iterator::operator++()
+{
+    mask &= mask - 1; // drop the lowest bit
+    return *this;
+}
+
+bool Sides::Iterator::operator!=(const Iterator& other) const
+{
+    return mask != other.mask;
+}
+
+Sides::Sides(uint8_t mask)
+    : mask(mask)
+{
+}
+
+Sides::Iterator Sides::begin() const
+{
+    return Iterator(mask);
+}
+
+Sides::Iterator Sides::end() const
+{
+    return Iterator(0);
+}
+
 double Pipe::angle() const
 {
     double angle = 0;
 
-    switch (type) {
+    switch (*this) {
         case Half:
-            if (sides[Side::Right]) {
+            if (get(Side::Right)) {
                 angle = 90;
-            } else if (sides[Side::Bottom]) {
+            } else if (get(Side::Bottom)) {
                 angle = 180;
-            } else if (sides[Side::Left]) {
+            } else if (get(Side::Left)) {
                 angle = 270;
             }
             break;
         case Straight:
-            if (sides[Side::Right]) {
+            if (get(Side::Right)) {
                 angle = 90;
             }
             break;
         case Bent:
-            if (sides[Side::Right] && sides[Side::Bottom]) {
+            if (get(Side::Right) && get(Side::Bottom)) {
                 angle = 90;
-            } else if (sides[Side::Bottom] && sides[Side::Left]) {
+            } else if (get(Side::Bottom) && get(Side::Left)) {
                 angle = 180;
-            } else if (sides[Side::Left] && sides[Side::Top]) {
+            } else if (get(Side::Left) && get(Side::Top)) {
                 angle = 270;
             }
             break;
         case Fork:
-            if (!sides[Side::Top]) {
+            if (!get(Side::Top)) {
                 angle = 90;
-            } else if (!sides[Side::Right]) {
+            } else if (!get(Side::Right)) {
                 angle = 180;
-            } else if (!sides[Side::Bottom]) {
+            } else if (!get(Side::Bottom)) {
                 angle = 270;
             }
             break;
@@ -87,140 +147,125 @@ double Pipe::angle() const
 
 void Pipe::rotate(bool clockwise)
 {
-    auto old = sides;
+    constexpr uint8_t all = (1 << Side::max) - 1;
     if (clockwise) {
-        sides <<= 1;
-        if (old[old.size() - 1]) {
-            sides[0] = true;
-        }
+        sides = ((sides << 1) | (sides >> (Side::max - 1))) & all;
     } else {
-        sides >>= 1;
-        if (old[0]) {
-            sides[sides.size() - 1] = true;
-        }
+        sides = ((sides >> 1) | (sides << (Side::max - 1))) & all;
     }
 }
 
-std::vector<Side> Pipe::connections() const
+Sides Pipe::connections() const
 {
-    std::vector<Side> sides;
-    sides.reserve(Side::max);
-
-    for (const Side s : { Side::Top, Side::Right, Side::Bottom, Side::Left }) {
-        if (get(s)) {
-            sides.push_back(s);
-        }
-    }
-
-    return sides;
+    return Sides(sides);
 }
 
 bool Pipe::get(const Side& side) const
 {
-    return sides[side];
+    return sides & side.mask();
 }
 
 void Pipe::set(const Side& side)
 {
-    sides[side] = true;
-
-    switch (sides.count()) {
-        case 1:
-            type = Half;
-            break;
-        case 2:
-            type = (sides[Side::Top] && sides[Side::Bottom]) ||
-                    (sides[Side::Left] && sides[Side::Right])
-                ? Straight
-                : Bent;
-            break;
-        case 3:
-            type = Fork;
-            break;
-        default:
-            break;
-    }
+    sides |= side.mask();
 }
 
 Pipe::operator Type() const
 {
-    return type;
+    // clang-format off
+    static const Type types[1 << Side::max] = {
+        None,     // ----
+        Half,     // ---T
+        Half,     // --R-
+        Bent,     // --RT
+        Half,     // -B--
+        Straight, // -B-T
+        Bent,     // -BR-
+        Fork,     // -BRT
+        Half,     // L---
+        Bent,     // L--T
+        Straight, // L-R-
+        Fork,     // L-RT
+        Bent,     // LB--
+        Fork,     // LB-T
+        Fork,     // LBR-
+        Fork,     // LBRT
+    };
+    // clang-format on
+    return types[sides & ((1 << Side::max) - 1)];
 }
 
-Cell::Status Cell::update()
+Cell::Cell()
+    : object(Empty)
+    , active(false)
+    , locked(false)
+    , rotating(false)
 {
-    if (rotation()) {
-        const Uint64 diff = SDL_GetTicks64() - rotate_start;
-        if (diff >= rotation_time) {
-            // rotation completed
-            rotate_start = 0;
-            if (rotate_twice) {
-                rotate(rotate_clockwise);
-            } else {
-                return Cell::RotationComplete;
-            }
-        }
-        return Cell::RotationInProgress;
+}
+
+Rotation::Rotation(size_t index, Pipe& pipe, bool clockwise, uint64_t now)
+    : index(index)
+    , start(now)
+    , initial(pipe)
+    , twice(false)
+    , clockwise(clockwise)
+{
+    pipe.rotate(clockwise);
+}
+
+Rotation::Status Rotation::update(Pipe& pipe, uint64_t now)
+{
+    if (now - start < rotation_time) {
+        return RotationInProgress;
+    }
+
+    if (twice) {
+        // start next rotation
+        twice = false;
+        initial = pipe;
+        start = now;
+        pipe.rotate(clockwise);
+        return RotationInProgress;
     }
 
-    return Cell::Unchanged;
+    return RotationComplete;
 }
 
-double Cell::phase() const
+double Rotation::phase(uint64_t now) const
 {
     double phase = 1.0;
 
-    if (rotation()) {
-        const Uint64 diff = SDL_GetTicks64() - rotate_start;
-        if (diff < rotation_time) {
-            phase =
-                static_cast<double>(diff) / static_cast<double>(rotation_time);
-        }
+    const uint64_t diff = now - start;
+    if (diff < rotation_time) {
+        phase = static_cast<double>(diff) / static_cast<double>(rotation_time);
     }
 
     return phase;
 }
 
-double Cell::angle() const
+double Rotation::angle(uint64_t now) const
 {
-    double angle;
-
-    if (!rotation()) {
-        angle = pipe.angle();
-    } else {
-        angle = phase() * 90.0;
-        if (!rotate_clockwise) {
-            angle = -angle;
-        }
-        angle += rotate_pipe.angle();
+    double angle = phase(now) * 90.0;
+    if (!clockwise) {
+        angle = -angle;
     }
-
-    return angle;
+    return angle + initial.angle();
 }
 
-void Cell::rotate(bool clockwise)
-{
-    if (rotation()) {
-        // rotation in progress
-        if (rotate_clockwise == clockwise) {
-            rotate_twice = true;
-        } else if (rotate_twice) {
-            rotate_twice = false;
-        } else {
-            // back rotation
-            const Uint64 tick = SDL_GetTicks64();
-            const Uint64 passed = tick - rotate_start;
-            const Uint64 rest = rotation_time - passed;
-            rotate_start = tick - rest;
-            rotate_pipe = pipe;
-            pipe.rotate(clockwise);
-            rotate_clockwise = clockwise;
-        }
+void Rotation::rotate(Pipe& pipe, bool clockwise, uint64_t now)
+{
+    if (this->clockwise == clockwise) {
+        twice = true;
+    } else if (twice) {
+        twice = false;
     } else {
-        rotate_twice = false;
-        rotate_pipe = pipe;
-        rotate_clockwise = clockwise;
-        rotate_start = SDL_GetTicks64();
+        // back rotation
+        const uint64_t passed = now - start;
+        const uint64_t rest =
+            passed < rotation_time ? rotation_time - passed : 0;
+        start = now - rest;
+        initial = pipe;
         pipe.rotate(clockwise);
+        this->clockwise = clockwise;
     }
 }
@@ -4,8 +4,8 @@
 
 #pragma once
 
-#include <bitset>
-#include <vector>
+#include <cstddef>
+#include <cstdint>
 
 /** Position (coordinates). */
 struct Position {
@@ -37,10 +37,39 @@ public:
      */
     Side opposite() const;
 
+    /**
+     * Get bit mask of the side.
+     * @return side bit
+     */
+    inline uint8_t mask() const { return 1 << side; }
+
 private:
     Type side;
 };
 
+/** Set of sides packed into a bit mask, iterable without allocations. */
+class Sides {
+public:
+    /** Iterator over set bits. */
+    class Iterator {
+    public:
+        Iterator(uint8_t mask);
+        Side operator*() const;
+        Iterator& operator++();
+        bool operator!=(const Iterator& other) const;
+
+    private:
+        uint8_t mask;
+    };
+
+    Sides(uint8_t mask);
+    Iterator begin() const;
+    Iterator end() const;
+
+private:
+    uint8_t mask;
+};
+
 /** Game pipe. */
 class Pipe {
 public:
@@ -61,9 +90,9 @@ public:
 
     /**
      * Gat connection sides.
-     * @return array with connected sides
+     * @return set of connected sides
      */
-    std::vector<Side> connections() const;
+    Sides connections() const;
 
     /**
      * Check if side connected.
@@ -80,62 +109,76 @@ public:
 
     operator Type() const;
 
-    std::bitset<Side::max> sides; ///< Pipe sides
-    Type type = None;             ///< Type of the pipe
+    uint8_t sides = 0; ///< Bit mask of connected sides
 };
 
-/** Game cell. */
+/** Game cell: packed state of a single cell, animation is stored aside. */
 struct Cell {
+    /** Cell object type. */
+    enum Object : uint8_t { Empty, Sender, Receiver };
+
+    Cell();
+
+    Pipe pipe;         ///< Pipe
+    Object object : 2; ///< Installed object
+    bool active : 1;   ///< Cell connection state (active/passive)
+    bool locked : 1;   ///< Cell lock status (locked/unlocked)
+    bool rotating : 1; ///< Rotation in progress
+};
+
+/** Pipe rotation animation. */
+struct Rotation {
     /** Total 90 degree pipe rotation time. */
     static constexpr size_t rotation_time = 300;
 
-    /** Cell object type. */
-    enum Object { Empty, Sender, Receiver };
-
-    /** Cell state. */
+    /** Rotation state. */
     enum Status {
-        Unchanged,         ///< Cell state unchanged
         RotationComplete,  ///< Rotation complete
         RotationInProgress ///< Updating in progress
     };
 
     /**
-     * Update cell state.
-     * @return cell's current status
+     * Constructor: start pipe rotation.
+     * @param index index of the rotated cell
+     * @param pipe pipe to rotate
+     * @param clockwise rotate direction
+     * @param now current timestamp
      */
-    Status update();
+    Rotation(size_t index, Pipe& pipe, bool clockwise, uint64_t now);
 
     /**
-     * Check if rotation is in progress.
-     * @return true if rotation in progress
+     * Update rotation state.
+     * @param pipe rotated pipe
+     * @param now current timestamp
+     * @return current status
      */
-    inline bool rotation() const { return rotate_start != 0; }
+    Status update(Pipe& pipe, uint64_t now);
 
     /**
      * Get pipe rotation phase [0.0, 1.0].
+     * @param now current timestamp
      * @return pipe rotation phase
      */
-    double phase() const;
+    double phase(uint64_t now) const;
 
     /**
-     * Get pipe angle.
+     * Get current angle of the rotated pipe.
+     * @param now current timestamp
      * @return pipe angle
      */
-    double angle() const;
+    double angle(uint64_t now) const;
 
     /**
-     * Rotate pipe.
+     * Rotate pipe while the rotation is in progress.
+     * @param pipe pipe to rotate
      * @param clockwise rotate direction
+     * @param now current timestamp
      */
-    void rotate(bool clockwise);
-
-    Object object = Empty; ///< Installed object
-    bool active = false;   ///< Cell connection state (active/passive)
-    bool locked = false;   ///< Cell lock status (locked/unlocked)
-    Pipe pipe;             ///< Pipe
+    void rotate(Pipe& pipe, bool clockwise, uint64_t now);
 
-    size_t rotate_start;   ///< Rotation start timestamp
-    Pipe rotate_pipe;      ///< Start state of pipe before rotation
-    bool rotate_twice;     ///< Twice rotation flag
-    bool rotate_clockwise; ///< Rotate direction
+    size_t index;   ///< Index of the rotated cell
+    uint64_t start; ///< Rotation start timestamp
+    Pipe initial;   ///< Start state of pipe before rotation
+    bool twice;     ///< Twice rotation flag
+    bool clockwise; ///< Rotate direction
 };
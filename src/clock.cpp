@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: MIT
+// Animation clock.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "clock.hpp"
+
+#include <SDL2/SDL.h>
+
+uint64_t SystemClock::ticks()
+{
+    return SDL_GetTicks64();
+}
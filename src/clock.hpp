@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+// Animation clock.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <cstdint>
+
+/** Animation clock: the time source is sampled once per frame. */
+class Clock {
+public:
+    virtual ~Clock() = default;
+
+    /** Sample the time source, must be called at the beginning of a frame. */
+    inline void tick() { timestamp = ticks(); }
+
+    /**
+     * Get timestamp of the current frame.
+     * @return timestamp in milliseconds
+     */
+    inline uint64_t now() const { return timestamp; }
+
+protected:
+    /**
+     * Read the time source.
+     * @return current time in milliseconds
+     */
+    virtual uint64_t ticks() = 0;
+
+private:
+    uint64_t timestamp = 0;
+};
+
+/** System clock: SDL timer. */
+class SystemClock : public Clock {
+protected:
+    uint64_t ticks() override;
+};
+
+/** Manual clock: virtual time for tests and benchmarks. */
+class ManualClock : public Clock {
+public:
+    /**
+     * Move time forward.
+     * @param ms number of milliseconds
+     */
+    inline void advance(uint64_t ms) { time += ms; }
+
+protected:
+    uint64_t ticks() override { return time; }
+
+private:
+    uint64_t time = 0;
+};
@@ -6,25 +6,23 @@
 
 #include <cmath>
 
-#include "mtrand.hpp"
-
 Firework::Firework(const SDL_Rect& init)
     : initial(init)
     , birth_time(0)
+    , age_limit(0)
 {
 }
 
-void Firework::update()
+void Firework::update(uint64_t now, MtRand& random)
 {
-    const uint64_t cur_time = SDL_GetTicks64();
-    uint64_t age = cur_time - birth_time;
-    if (birth_time == 0 || age > age_limit) {
+    uint64_t age = now - birth_time;
+    if (age_limit == 0 || age > age_limit) {
         // reinitialize
         age = 0;
-        birth_time = cur_time;
-        age_limit = mtrand::get(500, 1500);
-        variant = mtrand::get(0, 4);
-        delta_x = static_cast<float>(mtrand::get(-1000, 1000)) / 1000;
+        birth_time = now;
+        age_limit = random.get(500, 1500);
+        variant = random.get(0, 4);
+        delta_x = static_cast<float>(random.get(-1000, 1000)) / 1000;
     }
     // recalc state
     const float phase = static_cast<float>(age) / age_limit;
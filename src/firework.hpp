@@ -8,6 +8,8 @@
 
 #include <cstdint>
 
+#include "mtrand.hpp"
+
 struct Firework {
     /**
      * Constructor.
@@ -15,8 +17,12 @@ struct Firework {
      */
     Firework(const SDL_Rect& init);
 
-    /** Update firework state. */
-    void update();
+    /**
+     * Update firework state.
+     * @param now current timestamp
+     * @param random PRNG used to create new particle
+     */
+    void update(uint64_t now, MtRand& random);
 
     SDL_Rect current; ///< Current position and size
     size_t variant;   ///< Texture variant [0-4)
@@ -24,8 +30,8 @@ struct Firework {
     double alpha;     ///< Current transparency
 
 private:
-    SDL_Rect initial;  ///< Initial position and size
-    size_t birth_time; ///< Creation timestamp
-    size_t age_limit;  ///< Age limit in ms
-    float delta_x;     ///< Direction and diff of the final x coordinate
+    SDL_Rect initial;    ///< Initial position and size
+    uint64_t birth_time; ///< Creation timestamp
+    uint64_t age_limit;  ///< Age limit in ms, 0 if not initialized
+    float delta_x;       ///< Direction and diff of the final x coordinate
 };
@@ -6,36 +6,29 @@
 
 #include "buildcfg.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
 
-struct LevelSize {
-    size_t size;
-    const char* name;
-};
-static const LevelSize level_sizes[] = {
-    { 10, "10 * 10" },
-    { 15, "15 * 15" },
-    { 20, "20 * 20" },
-    { 30, "30 * 30" },
-};
-
-Game::Game(SDL_Window* wnd, SDL_Renderer* renderer)
+Game::Game(SDL_Window* wnd, SDL_Renderer* renderer, const Clock& clock)
     : window(wnd)
+    , clock(clock)
     , layout()
     , render(renderer)
     , puzzle_mode(true)
+    , redraw(true)
 {
 }
 
 bool Game::initialize(const State& state)
 {
-    SDL_Surface* skin_image = skin.initialize(state.skin);
-    if (!skin_image) {
+    const Skin::Loader loader = std::bind(&Game::load_skin, this,
+                                          std::placeholders::_1,
+                                          std::placeholders::_2);
+    if (!skin.initialize(state.skin, loader)) {
         printf("Failed to load textures\n");
         return false;
     }
-    render.load(skin_image);
-    SDL_FreeSurface(skin_image);
 
     sound.initialize();
     sound.enable = state.sound;
@@ -52,7 +45,11 @@ bool Game::initialize(const State& state)
     layout.update(level.width, level.height);
 
     if (level.load(state.level_pipes)) {
-        level.update();
+        if (!journal.load(state.journal, state.journal_position,
+                          level.width * level.height)) {
+            journal.clear();
+        }
+        level.update(clock.now());
     } else {
         reset_level(true);
     }
@@ -95,6 +92,16 @@ void Game::handle_event(const SDL_Event& event)
                         reset_level(true);
                     }
                     break;
+                case SDLK_z:
+                    if (event.key.keysym.mod & KMOD_CTRL) {
+                        replay(!(event.key.keysym.mod & KMOD_SHIFT));
+                    }
+                    break;
+                case SDLK_y:
+                    if (event.key.keysym.mod & KMOD_CTRL) {
+                        replay(false);
+                    }
+                    break;
             }
             break;
         case SDL_MOUSEBUTTONDOWN:
@@ -108,14 +115,20 @@ void Game::handle_event(const SDL_Event& event)
                     // reinit fireworks with new coordinates
                     create_fireworks();
                 }
+                redraw = true;
             }
             break;
+        case SDL_RENDER_TARGETS_RESET:
+        case SDL_RENDER_DEVICE_RESET:
+            redraw = true; // content of the cached layer is lost
+            break;
     }
 }
 
 bool Game::update()
 {
-    level.update();
+    level.update(clock.now());
+    sound.update();
 
     if (level.state.level_complete) {
         if (fireworks.empty()) {
@@ -124,7 +137,7 @@ bool Game::update()
         }
         // update fireworks
         for (auto& it : fireworks) {
-            it.update();
+            it.update(clock.now(), random);
         }
     }
 
@@ -137,19 +150,62 @@ bool Game::update()
 
 void Game::draw()
 {
+    const bool cached =
+        puzzle_mode && render.prepare_layer(layout.window.w, layout.window.h);
+    if (cached) {
+        update_layer();
+    }
+
     render.clear();
-    render.fill_background(layout.window.w, layout.window.h);
-    render.draw(Render::Title, layout.title);
 
-    if (puzzle_mode) {
-        draw_puzzle();
-    } else {
+    if (!puzzle_mode) {
+        render.fill_background(layout.window.w, layout.window.h);
+        render.draw(Render::Title, layout.title);
         draw_settings();
+        redraw = true; // settings view doesn't use cached layer
+    } else {
+        if (cached) {
+            render.draw_layer();
+        } else {
+            // render targets are not supported, draw the whole scene
+            draw_puzzle();
+        }
+        draw_animation();
+    }
+}
+
+void Game::draw_overlay(const std::string& text)
+{
+    const size_t font_sz = std::max<size_t>(layout.base_size / 4, 8);
+    int y = font_sz / 2;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        const std::string line = text.substr(start, end - start);
+        render.draw_text(line.c_str(), font_sz, font_sz / 2, y);
+        y += font_sz;
+        start = end + 1;
     }
+}
 
+void Game::flush()
+{
     render.flush();
 }
 
+const Render::Stats& Game::render_stats() const
+{
+    return render.stats;
+}
+
+uint64_t Game::audio_latency_estimate() const
+{
+    return sound.latency_estimate();
+}
+
 void Game::save(State& state) const
 {
     state.level_id = level.id;
@@ -157,133 +213,233 @@ void Game::save(State& state) const
     state.level_height = level.height;
     state.level_wrap = level.wrap;
     state.level_pipes = level.save();
+    state.journal_position = journal.save(state.journal);
     state.skin = skin.name;
     state.sound = sound.enable;
 }
 
+/**
+ * Get texture of the pipe.
+ * @param cell cell with pipe
+ * @param shadow shadow flag
+ * @return texture id, Render::Font if cell doesn't have a pipe
+ */
+static Render::TextureId pipe_texture(const Cell& cell, bool shadow)
+{
+    switch (cell.pipe) {
+        case Pipe::Half:
+            return shadow ? Render::PipeHalfShadow
+                          : (cell.active ? Render::PipeHalfOn
+                                         : Render::PipeHalfOff);
+        case Pipe::Straight:
+            return shadow ? Render::PipeStrShadow
+                          : (cell.active ? Render::PipeStrOn
+                                         : Render::PipeStrOff);
+        case Pipe::Bent:
+            return shadow ? Render::PipeBentShadow
+                          : (cell.active ? Render::PipeBentOn
+                                         : Render::PipeBentOff);
+        case Pipe::Fork:
+            return shadow ? Render::PipeForkShadow
+                          : (cell.active ? Render::PipeForkOn
+                                         : Render::PipeForkOff);
+        default:
+            return Render::Font;
+    }
+}
+
+/**
+ * Draw cell object (sender/receiver).
+ * @param render renderer instance
+ * @param cell cell to draw
+ * @param dst position and size
+ */
+static void draw_object(Render& render, const Cell& cell, SDL_Rect& dst)
+{
+    switch (cell.object) {
+        case Cell::Sender:
+            render.draw(Render::Sender, dst);
+            break;
+        case Cell::Receiver:
+            if (cell.active) {
+                render.draw(Render::ReceiverOn, dst);
+            } else {
+                render.draw(Render::ReceiverOff, dst);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void Game::update_layer()
+{
+    // max number of changed cells redrawn separately
+    const size_t max_dirty = 32;
+
+    if (!level.take_changes(dirty) || dirty.size() > max_dirty) {
+        redraw = true;
+    }
+
+    if (redraw) {
+        render.begin_layer(nullptr);
+        draw_puzzle();
+        render.end_layer();
+        redraw = false;
+    } else {
+        std::sort(dirty.begin(), dirty.end());
+        dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+        // redraw the cell and its shadow, which falls on the neighbors
+        const int shadow_shift = layout.cell_size / 20;
+        for (const size_t index : dirty) {
+            const size_t x = index % level.width;
+            const size_t y = index / level.width;
+            const SDL_Rect area = {
+                static_cast<int>(layout.field.x + x * layout.cell_size),
+                static_cast<int>(layout.field.y + y * layout.cell_size),
+                static_cast<int>(layout.cell_size) + shadow_shift,
+                static_cast<int>(layout.cell_size) + shadow_shift
+            };
+            render.begin_layer(&area);
+            draw_area(area, x, y, false);
+            render.end_layer();
+        }
+    }
+
+    dirty.clear();
+}
+
 void Game::draw_puzzle()
+{
+    render.fill_background(layout.window.w, layout.window.h);
+    draw_cells(0, 0, level.width, level.height, false);
+    draw_frame();
+}
+
+void Game::draw_frame()
+{
+    render.draw(Render::Title, layout.title);
+
+    // buttons
+    render.draw(Render::ButtonReset, layout.reset);
+    render.draw(Render::ButtonPrev, layout.lvlprev);
+    render.draw(Render::ButtonNext, layout.lvlnext);
+    render.draw(Render::ButtonSettings, layout.settings);
+
+    // level Id
+    char level_id[32];
+    sprintf(level_id, "%08u", level.id);
+    const size_t font_sz = layout.reset->h * 0.7;
+    const size_t width = render.text_width(level_id, font_sz);
+    render.draw_text(level_id, font_sz,
+                     layout.window.w / 2 - width / 2 - font_sz / 10,
+                     layout.field.y + layout.field.h + font_sz / 3);
+}
+
+void Game::draw_area(const SDL_Rect& area, size_t x, size_t y, bool animated)
+{
+    render.fill_background(layout.window.w, layout.window.h);
+    draw_cells(x ? x - 1 : 0, y ? y - 1 : 0, std::min(x + 2, level.width),
+               std::min(y + 2, level.height), animated);
+
+    // the area can cover the header or footer near the field
+    const SDL_Rect& field = layout.field;
+    if (area.x < field.x || area.y < field.y ||
+        area.x + area.w > field.x + field.w ||
+        area.y + area.h > field.y + field.h) {
+        draw_frame();
+    }
+}
+
+void Game::draw_cells(size_t x0, size_t y0, size_t x1, size_t y1,
+                      bool animated)
 {
     SDL_Rect dst = { 0, 0, static_cast<int>(layout.cell_size),
                      static_cast<int>(layout.cell_size) };
+    const int shadow_shift = layout.cell_size / 20;
+    const int lift_shift = layout.cell_size / 16;
+    const uint64_t now = clock.now();
 
     // cells background
-    for (size_t y = 0; y < level.height; ++y) {
-        for (size_t x = 0; x < level.width; ++x) {
+    for (size_t y = y0; y < y1; ++y) {
+        for (size_t x = x0; x < x1; ++x) {
             dst.x = layout.field.x + x * layout.cell_size;
             dst.y = layout.field.y + y * layout.cell_size;
             render.draw(Render::CellBkg, dst);
         }
     }
 
-    // pipes shadow
-    const int shadow_shift = layout.cell_size / 20;
-    const int lift_shift = layout.cell_size / 16;
-    for (size_t y = 0; y < level.height; ++y) {
-        for (size_t x = 0; x < level.width; ++x) {
-            const Cell& cell = level.get_cell({ x, y });
-            dst.x = layout.field.x + x * layout.cell_size + shadow_shift;
-            dst.y = layout.field.y + y * layout.cell_size + shadow_shift;
-            Render::TextureId tid;
-            switch (cell.pipe) {
-                case Pipe::Half:
-                    tid = Render::PipeHalfShadow;
-                    break;
-                case Pipe::Straight:
-                    tid = Render::PipeStrShadow;
-                    break;
-                case Pipe::Bent:
-                    tid = Render::PipeBentShadow;
-                    break;
-                case Pipe::Fork:
-                    tid = Render::PipeForkShadow;
-                    break;
-                default:
-                    continue;
-            }
-            if (cell.rotation()) {
-                const int shift = lift_shift * sin(M_PI * cell.phase());
-                dst.x += shift;
-                dst.y += shift;
-            }
-            render.draw(tid, dst, cell.angle(), 0.3);
-        }
-    }
-
-    // pipes
-    for (size_t y = 0; y < level.height; ++y) {
-        for (size_t x = 0; x < level.width; ++x) {
-            Render::TextureId tid;
-            const Cell& cell = level.get_cell({ x, y });
-            dst.x = layout.field.x + x * layout.cell_size;
-            dst.y = layout.field.y + y * layout.cell_size;
-            switch (cell.pipe) {
-                case Pipe::Half:
-                    tid =
-                        cell.active ? Render::PipeHalfOn : Render::PipeHalfOff;
-                    break;
-                case Pipe::Straight:
-                    tid = cell.active ? Render::PipeStrOn : Render::PipeStrOff;
-                    break;
-                case Pipe::Bent:
-                    tid =
-                        cell.active ? Render::PipeBentOn : Render::PipeBentOff;
-                    break;
-                case Pipe::Fork:
-                    tid =
-                        cell.active ? Render::PipeForkOn : Render::PipeForkOff;
-                    break;
-                default:
+    // pipes: shadows first, then pipes itself
+    for (size_t pass = 0; pass < 2; ++pass) {
+        const bool shadow = (pass == 0);
+        for (size_t y = y0; y < y1; ++y) {
+            for (size_t x = x0; x < x1; ++x) {
+                const Cell& cell = level.get_cell({ x, y });
+                if (cell.pipe == Pipe::None || (cell.rotating && !animated)) {
                     continue;
+                }
+                double angle = cell.pipe.angle();
+                int shift = 0;
+                if (cell.rotating) {
+                    const Rotation* rotation = level.get_rotation({ x, y });
+                    angle = rotation->angle(now);
+                    shift = lift_shift * sin(M_PI * rotation->phase(now));
+                }
+                dst.x = layout.field.x + x * layout.cell_size;
+                dst.y = layout.field.y + y * layout.cell_size;
+                if (shadow) {
+                    dst.x += shadow_shift + shift;
+                    dst.y += shadow_shift + shift;
+                    render.draw(pipe_texture(cell, true), dst, angle, 0.3);
+                } else {
+                    dst.x -= shift;
+                    dst.y -= shift;
+                    render.draw(pipe_texture(cell, false), dst, angle);
+                }
             }
-            if (cell.rotation()) {
-                const int shift = lift_shift * sin(M_PI * cell.phase());
-                dst.x -= shift;
-                dst.y -= shift;
-            }
-            render.draw(tid, dst, cell.angle());
         }
     }
 
     // cell objects
-    for (size_t y = 0; y < level.height; ++y) {
-        for (size_t x = 0; x < level.width; ++x) {
+    for (size_t y = y0; y < y1; ++y) {
+        for (size_t x = x0; x < x1; ++x) {
             const Cell& cell = level.get_cell({ x, y });
             dst.x = layout.field.x + x * layout.cell_size;
             dst.y = layout.field.y + y * layout.cell_size;
-            switch (cell.object) {
-                case Cell::Sender:
-                    render.draw(Render::Sender, dst);
-                    break;
-                case Cell::Receiver:
-                    if (cell.active) {
-                        render.draw(Render::ReceiverOn, dst);
-                    } else {
-                        render.draw(Render::ReceiverOff, dst);
-                    }
-                    break;
-                default:
-                    break;
+            if (!cell.rotating || animated) {
+                draw_object(render, cell, dst);
             }
             if (cell.locked) {
                 render.draw(Render::Lock, dst);
             }
         }
     }
+}
 
-    // buttons
-    render.draw(Render::ButtonReset, layout.reset);
-    render.draw(Render::ButtonPrev, layout.lvlprev);
-    render.draw(Render::ButtonNext, layout.lvlnext);
-    render.draw(Render::ButtonSettings, layout.settings);
-
-    // level Id
-    char level_id[32];
-    sprintf(level_id, "%08u", level.id);
-    const size_t font_sz = layout.reset->h * 0.7;
-    const size_t width = render.text_width(level_id, font_sz);
-    render.draw_text(level_id, font_sz,
-                     layout.window.w / 2 - width / 2 - font_sz / 10,
-                     layout.field.y + layout.field.h + font_sz / 3);
+void Game::draw_animation()
+{
+    // rotating pipes are drawn over the static scene together with their
+    // neighbors, so that shadows and locks keep the stacking order; the
+    // area covers rotated corners, the lift and the shadow of the pipe
+    const int margin = layout.cell_size / 4;
+    const int shadow_shift = layout.cell_size / 20;
+    const int lift_shift = layout.cell_size / 16;
+    for (const Rotation& rotation : level.rotations) {
+        const size_t x = rotation.index % level.width;
+        const size_t y = rotation.index / level.width;
+        const SDL_Rect area = {
+            static_cast<int>(layout.field.x + x * layout.cell_size) - margin,
+            static_cast<int>(layout.field.y + y * layout.cell_size) - margin,
+            static_cast<int>(layout.cell_size) + margin * 2 + shadow_shift +
+                lift_shift,
+            static_cast<int>(layout.cell_size) + margin * 2 + shadow_shift +
+                lift_shift
+        };
+        render.set_clip(&area);
+        draw_area(area, x, y, true);
+    }
+    render.set_clip(nullptr);
 
     // draw particles
     for (auto& it : fireworks) {
@@ -303,11 +459,14 @@ void Game::draw_settings()
     width = render.text_width(lvlsize, font_sz);
     render.draw_text(lvlsize, font_sz, layout.window.w / 2 - width / 2,
                      layout.lvlsize[0]->y - font_sz * 1.2);
-    for (size_t i = 0; i < sizeof(level_sizes) / sizeof(level_sizes[0]); ++i) {
+    for (size_t i = 0; i < Level::sizes_num; ++i) {
+        char name[16];
+        snprintf(name, sizeof(name), "%zu * %zu", Level::sizes[i],
+                 Level::sizes[i]);
         render.draw(layout.lvlsize[i].checked ? Render::ButtonCbOn
                                               : Render::ButtonCbOff,
                     layout.lvlsize[i]);
-        render.draw_text(level_sizes[i].name, layout.lvlsize[i]->h,
+        render.draw_text(name, layout.lvlsize[i]->h,
                          layout.lvlsize[i]->x + layout.lvlsize[i]->w,
                          layout.lvlsize[i]->y);
     }
@@ -360,9 +519,12 @@ void Game::on_mouse_click_puzzle(int x, int y, int button)
 
         if (!cell.locked &&
             (button == SDL_BUTTON_LEFT || button == SDL_BUTTON_RIGHT)) {
-            level.rotate(pos, button == SDL_BUTTON_RIGHT);
+            const bool clockwise = (button == SDL_BUTTON_RIGHT);
+            level.rotate(pos, clockwise, clock.now());
+            journal.push(pos.y * level.width + pos.x, clockwise);
         } else if (button == SDL_BUTTON_MIDDLE && cell.pipe != Pipe::None) {
             cell.locked = !cell.locked;
+            dirty.push_back(pos.y * level.width + pos.x);
         }
     } else if (layout.reset.own(x, y)) {
         reset_level(false);
@@ -379,17 +541,18 @@ void Game::on_mouse_click_puzzle(int x, int y, int button)
     } else if (layout.settings.own(x, y)) {
         puzzle_mode = false;
         layout.wrap.checked = level.wrap;
-        for (size_t i = 0; i < sizeof(level_sizes) / sizeof(level_sizes[0]);
-             ++i) {
-            layout.lvlsize[i].checked = (level.width == level_sizes[i].size &&
-                                         level.height == level_sizes[i].size);
+        for (size_t i = 0; i < Level::sizes_num; ++i) {
+            layout.lvlsize[i].checked = (level.width == Level::sizes[i] &&
+                                         level.height == Level::sizes[i]);
         }
     }
 }
 
 void Game::on_mouse_click_settings(int x, int y, int /*button*/)
 {
-    SDL_Surface* skin_image = nullptr;
+    const Skin::Loader loader = std::bind(&Game::load_skin, this,
+                                          std::placeholders::_1,
+                                          std::placeholders::_2);
 
     if (layout.settings.own(x, y)) {
         bool regen_level = false;
@@ -397,10 +560,9 @@ void Game::on_mouse_click_settings(int x, int y, int /*button*/)
             level.wrap = layout.wrap.checked;
             regen_level = true;
         }
-        for (size_t i = 0; i < sizeof(level_sizes) / sizeof(level_sizes[0]);
-             ++i) {
+        for (size_t i = 0; i < Level::sizes_num; ++i) {
             if (layout.lvlsize[i].checked) {
-                const size_t lvl_sz = level_sizes[i].size;
+                const size_t lvl_sz = Level::sizes[i];
                 if (level.width != lvl_sz || level.height != lvl_sz) {
                     level.width = lvl_sz;
                     level.height = lvl_sz;
@@ -418,9 +580,13 @@ void Game::on_mouse_click_settings(int x, int y, int /*button*/)
     } else if (layout.sound.own(x, y)) {
         sound.enable = !sound.enable;
     } else if (layout.skinprev.own(x, y)) {
-        skin_image = skin.prev();
+        if (skin.prev(loader)) {
+            redraw = true;
+        }
     } else if (layout.skinnext.own(x, y)) {
-        skin_image = skin.next();
+        if (skin.next(loader)) {
+            redraw = true;
+        }
     } else {
         // handle level size switch
         int index = -1;
@@ -438,29 +604,54 @@ void Game::on_mouse_click_settings(int x, int y, int /*button*/)
             }
         }
     }
-
-    if (skin_image) {
-        render.load(skin_image);
-        SDL_FreeSurface(skin_image);
-    }
 }
 
 void Game::reset_level(bool regen)
 {
     fireworks.clear();
+    journal.clear();
+    redraw = true;
 
     if (regen) {
         level.generate();
         layout.update(level.width, level.height);
     }
 
-    level.reset();
-    level.update();
+    level.reset(clock.now());
+    level.update(clock.now());
+}
+
+void Game::replay(bool undo)
+{
+    if (!puzzle_mode || level.state.level_complete) {
+        return;
+    }
+
+    size_t index;
+    bool clockwise;
+    const bool found =
+        undo ? journal.undo(index, clockwise) : journal.redo(index, clockwise);
+    if (!found) {
+        return;
+    }
+
+    const Position pos = { index % level.width, index / level.width };
+    if (level.get_cell(pos).locked) {
+        // locked cell stops the replay: put the move back to the journal
+        bool dummy;
+        undo ? journal.redo(index, dummy) : journal.undo(index, dummy);
+        return;
+    }
+
+    // same path as a mouse click: the network is updated incrementally and
+    // the rotation sound is played by update() when the rotation completes
+    level.rotate(pos, clockwise, clock.now());
 }
 
 void Game::create_fireworks()
 {
     const size_t fw_per_rcv = 4;
+    random.seed(level.id);
     fireworks.clear();
     fireworks.reserve(level.recievers.size() * fw_per_rcv);
     for (size_t y = 0; y < level.height; ++y) {
@@ -479,3 +670,19 @@ void Game::create_fireworks()
         }
     }
 }
+
+bool Game::load_skin(const std::string& name, const std::string& path)
+{
+    if (render.select(name)) {
+        return true; // already loaded
+    }
+
+    SDL_Surface* image = skin.image(path);
+    if (!image) {
+        return false;
+    }
+    const bool rc = render.load(name, image);
+    SDL_FreeSurface(image);
+
+    return rc;
+}
@@ -6,9 +6,12 @@
 
 #include <SDL2/SDL.h>
 
+#include <string>
 #include <vector>
 
+#include "clock.hpp"
 #include "firework.hpp"
+#include "journal.hpp"
 #include "layout.hpp"
 #include "level.hpp"
 #include "render.hpp"
@@ -23,8 +26,9 @@ public:
      * Constructor.
      * @param window game window
      * @param renderer image renderer
+     * @param clock animation clock, sampled by the caller once per frame
      */
-    Game(SDL_Window* wnd, SDL_Renderer* renderer);
+    Game(SDL_Window* wnd, SDL_Renderer* renderer, const Clock& clock);
 
     /**
      * Initialization.
@@ -48,6 +52,27 @@ public:
     /** Draw scene. */
     void draw();
 
+    /**
+     * Draw text over the scene.
+     * @param text multiline text to draw
+     */
+    void draw_overlay(const std::string& text);
+
+    /** Present the drawn scene. */
+    void flush();
+
+    /**
+     * Get render statistics.
+     * @return statistics of the last presented frame
+     */
+    const Render::Stats& render_stats() const;
+
+    /**
+     * Get estimate of audio output latency.
+     * @return latency estimate of the last played sound in microseconds
+     */
+    uint64_t audio_latency_estimate() const;
+
     /**
      * Save state.
      * @param state game state container
@@ -55,9 +80,36 @@ public:
     void save(State& state) const;
 
 private:
-    /** Draw puzzle view. */
+    /** Update cached layer: redraw it completely or changed cells only. */
+    void update_layer();
+
+    /** Draw static part of the puzzle view. */
     void draw_puzzle();
 
+    /** Draw title, buttons and level id. */
+    void draw_frame();
+
+    /**
+     * Redraw part of the puzzle view around the cell, the area must be set
+     * as clip region.
+     * @param area clip region
+     * @param x,y cell in the center of the area
+     * @param animated true to draw rotating pipes
+     */
+    void draw_area(const SDL_Rect& area, size_t x, size_t y, bool animated);
+
+    /**
+     * Draw range of cells.
+     * @param x0,y0 top-left cell of the range to draw
+     * @param x1,y1 bottom-right cell of the range (not included)
+     * @param animated true to draw rotating pipes, skip them otherwise
+     */
+    void draw_cells(size_t x0, size_t y0, size_t x1, size_t y1,
+                    bool animated);
+
+    /** Draw animated part of the puzzle view: rotating pipes, fireworks. */
+    void draw_animation();
+
     /** Draw settings view. */
     void draw_settings();
 
@@ -79,13 +131,34 @@ private:
     /** (Re)create fireworks particles. */
     void create_fireworks();
 
+    /**
+     * Undo or redo the move from the journal.
+     * Replay stops at locked cells, the journal position is kept.
+     * @param undo true to undo, false to redo
+     */
+    void replay(bool undo);
+
+    /**
+     * Load skin to the renderer, skins loaded before are reused.
+     * @param name skin name
+     * @param path path to the skin file
+     * @return false if skin can not be loaded
+     */
+    bool load_skin(const std::string& name, const std::string& path);
+
     SDL_Window* window; ///< Main window
+    const Clock& clock; ///< Animation clock
     Layout layout;      ///< Window layout
     Sound sound;        ///< Sound support
     Level level;        ///< Game level
+    Journal journal;    ///< History of moves
     Skin skin;          ///< Skin loader
     Render render;      ///< Image drawer
     bool puzzle_mode;   ///< Currently active mode (puzzle/settings)
+    bool redraw;        ///< Cached layer must be redrawn completely
+
+    std::vector<size_t> dirty; ///< Changed cells to redraw in cached layer
 
     std::vector<Firework> fireworks; ///< Completion animation
+    MtRand random;                   ///< PRNG for fireworks
 };
@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: MIT
+// Batch level generator.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "generator.hpp"
+
+/** Number of levels taken by a worker at once. */
+static constexpr uint32_t chunk_size = 32;
+
+Generator::Generator(size_t width, size_t height, bool wrap)
+    : width(width)
+    , height(height)
+    , wrap(wrap)
+    , out_lock(nullptr)
+    , out(nullptr)
+    , out_next(0)
+{
+}
+
+bool Generator::run(uint32_t first, uint32_t last, FILE* out)
+{
+    this->out = out;
+    out_next = first;
+    out_queue.clear();
+    out_lock = SDL_CreateMutex();
+    if (!out_lock) {
+        fprintf(stderr, "Unable to create mutex: %s\n", SDL_GetError());
+        return false;
+    }
+
+    // split the range between workers, the rest is balanced by stealing
+    const uint32_t total = last - first + 1;
+    size_t threads = SDL_GetCPUCount();
+    if (threads < 1) {
+        threads = 1;
+    } else if (threads > total) {
+        threads = total;
+    }
+    workers.resize(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        Worker& worker = workers[i];
+        worker.owner = this;
+        worker.thread = nullptr;
+        worker.lock = SDL_CreateMutex();
+        worker.next = first + static_cast<uint64_t>(total) * i / threads;
+        worker.end = first + static_cast<uint64_t>(total) * (i + 1) / threads;
+        worker.level.width = width;
+        worker.level.height = height;
+        worker.level.wrap = wrap;
+    }
+
+    fprintf(out, "# id\twidth\theight\twrap\treceivers\thalf\tstraight\tbent"
+                 "\tfork\tpipes\n");
+
+    const uint64_t start = SDL_GetTicks64();
+
+    bool rc = true;
+    for (auto& it : workers) {
+        if (!it.lock) {
+            rc = false;
+            break;
+        }
+        it.thread = SDL_CreateThread(&Generator::work, "generator", &it);
+        if (!it.thread) {
+            fprintf(stderr, "Unable to create thread: %s\n", SDL_GetError());
+            rc = false;
+            break;
+        }
+    }
+    if (!rc) {
+        // stop started workers
+        for (auto& it : workers) {
+            if (it.lock) {
+                SDL_LockMutex(it.lock);
+                it.end = it.next;
+                SDL_UnlockMutex(it.lock);
+            }
+        }
+    }
+
+    // locks can be used by other workers, so destroy them after all threads
+    for (auto& it : workers) {
+        if (it.thread) {
+            SDL_WaitThread(it.thread, nullptr);
+        }
+    }
+    for (auto& it : workers) {
+        if (it.lock) {
+            SDL_DestroyMutex(it.lock);
+        }
+    }
+    workers.clear();
+    SDL_DestroyMutex(out_lock);
+    out_lock = nullptr;
+
+    if (rc) {
+        const uint64_t ms = SDL_GetTicks64() - start;
+        fprintf(stderr, "Generated %u levels in %llu ms using %zu threads\n",
+                total, static_cast<unsigned long long>(ms), threads);
+    }
+
+    return rc;
+}
+
+int Generator::work(void* data)
+{
+    Worker& worker = *reinterpret_cast<Worker*>(data);
+    Generator& gen = *worker.owner;
+
+    uint32_t begin, end;
+    while (gen.take(worker, begin, end)) {
+        worker.output.clear();
+        for (uint32_t id = begin; id < end; ++id) {
+            worker.level.id = id;
+            worker.level.generate();
+            gen.describe(worker.level, worker.output);
+        }
+        gen.print(begin, end, worker.output);
+    }
+
+    return 0;
+}
+
+void Generator::print(uint32_t begin, uint32_t end, std::string& text)
+{
+    SDL_LockMutex(out_lock);
+
+    if (begin != out_next) {
+        // preceding levels are not generated yet
+        Chunk& chunk = out_queue[begin];
+        chunk.end = end;
+        chunk.text.swap(text);
+    } else {
+        fwrite(text.data(), 1, text.size(), out);
+        out_next = end;
+        // print queued chunks that follow the current one
+        auto it = out_queue.begin();
+        while (it != out_queue.end() && it->first == out_next) {
+            fwrite(it->second.text.data(), 1, it->second.text.size(), out);
+            out_next = it->second.end;
+            it = out_queue.erase(it);
+        }
+    }
+
+    SDL_UnlockMutex(out_lock);
+}
+
+bool Generator::take(Worker& worker, uint32_t& begin, uint32_t& end)
+{
+    do {
+        SDL_LockMutex(worker.lock);
+        begin = worker.next;
+        end = worker.end - begin > chunk_size ? begin + chunk_size : worker.end;
+        worker.next = end;
+        SDL_UnlockMutex(worker.lock);
+        if (begin != end) {
+            return true;
+        }
+    } while (steal(worker));
+
+    return false;
+}
+
+bool Generator::steal(Worker& thief)
+{
+    while (true) {
+        // find the victim with the largest remaining range
+        Worker* victim = nullptr;
+        uint32_t max_rest = 0;
+        for (auto& it : workers) {
+            if (&it == &thief) {
+                continue;
+            }
+            SDL_LockMutex(it.lock);
+            const uint32_t rest = it.end - it.next;
+            SDL_UnlockMutex(it.lock);
+            if (rest > max_rest) {
+                max_rest = rest;
+                victim = &it;
+            }
+        }
+        if (!victim) {
+            return false; // all work is done
+        }
+
+        // take the upper half of the victim's range
+        SDL_LockMutex(victim->lock);
+        const uint32_t rest = victim->end - victim->next;
+        const uint32_t end = victim->end;
+        const uint32_t begin = end - (rest + 1) / 2;
+        victim->end = begin;
+        SDL_UnlockMutex(victim->lock);
+
+        if (begin != end) {
+            SDL_LockMutex(thief.lock);
+            thief.next = begin;
+            thief.end = end;
+            SDL_UnlockMutex(thief.lock);
+            return true;
+        }
+        // victim completed its range in the meantime, try again
+    }
+}
+
+void Generator::describe(const Level& level, std::string& out) const
+{
+    size_t pipes[Pipe::Fork + 1] = {};
+    for (const Cell& cell : level.cells) {
+        ++pipes[static_cast<Pipe::Type>(cell.pipe)];
+    }
+
+    char info[128];
+    snprintf(info, sizeof(info), "%u\t%zu\t%zu\t%d\t%zu\t%zu\t%zu\t%zu\t%zu\t",
+             level.id, level.width, level.height, level.wrap ? 1 : 0,
+             level.recievers.size(), pipes[Pipe::Half], pipes[Pipe::Straight],
+             pipes[Pipe::Bent], pipes[Pipe::Fork]);
+    out += info;
+    out += level.save();
+    out += '\n';
+}
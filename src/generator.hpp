@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: MIT
+// Batch level generator.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "level.hpp"
+
+/** Batch level generator: generates range of levels on all CPU cores. */
+class Generator {
+public:
+    /**
+     * Constructor.
+     * @param width,height level size
+     * @param wrap wrap mode flag
+     */
+    Generator(size_t width, size_t height, bool wrap);
+
+    /**
+     * Generate levels and print their description.
+     * Output lines are sorted by level id.
+     * @param first id of the first level
+     * @param last id of the last level
+     * @param out output stream
+     * @return false if something went wrong
+     */
+    bool run(uint32_t first, uint32_t last, FILE* out);
+
+private:
+    /** Worker thread context. */
+    struct Worker {
+        Generator* owner;   ///< Owner instance
+        SDL_Thread* thread; ///< Thread handle
+        SDL_mutex* lock;    ///< Guard for the range of ids
+        uint32_t next;      ///< Next level id to generate
+        uint32_t end;       ///< End of the range (not included)
+        Level level;        ///< Level instance used by this worker
+        std::string output; ///< Output buffer
+    };
+
+    /** Generated chunk waiting for its turn to be printed. */
+    struct Chunk {
+        uint32_t end;     ///< End of the range (not included)
+        std::string text; ///< Description of levels
+    };
+
+    /**
+     * Worker thread entry point.
+     * @param data pointer to the worker context
+     * @return thread exit code
+     */
+    static int work(void* data);
+
+    /**
+     * Get next chunk of ids, steal it from other workers if own range is
+     * completed.
+     * @param worker worker context
+     * @param begin,end range of ids to generate
+     * @return false if there is no more work
+     */
+    bool take(Worker& worker, uint32_t& begin, uint32_t& end);
+
+    /**
+     * Steal half of the largest remaining range from other workers.
+     * @param thief worker that needs a new job
+     * @return false if all work is done
+     */
+    bool steal(Worker& thief);
+
+    /**
+     * Print generated chunk, keep it until all preceding chunks are printed.
+     * @param begin id of the first level in the chunk
+     * @param end end of the range (not included)
+     * @param text description of levels
+     */
+    void print(uint32_t begin, uint32_t end, std::string& text);
+
+    /**
+     * Print description of the generated level.
+     * @param level generated level
+     * @param out output buffer
+     */
+    void describe(const Level& level, std::string& out) const;
+
+    size_t width;  ///< Level width
+    size_t height; ///< Level height
+    bool wrap;     ///< Wrap mode flag
+
+    std::vector<Worker> workers;         ///< Worker threads
+    SDL_mutex* out_lock;                 ///< Guard for the output stream
+    FILE* out;                           ///< Output stream
+    uint32_t out_next;                   ///< Id of the next level to print
+    std::map<uint32_t, Chunk> out_queue; ///< Chunks waiting for their turn
+};
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: MIT
+// Journal of moves (undo/redo history).
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "journal.hpp"
+
+/** Bit of the packed move: clockwise rotation. */
+static constexpr uint16_t clockwise_bit = 1 << 15;
+
+Journal::Journal()
+    : first(0)
+    , done(0)
+    , total(0)
+{
+}
+
+void Journal::clear()
+{
+    first = 0;
+    done = 0;
+    total = 0;
+}
+
+void Journal::push(size_t index, bool clockwise)
+{
+    if (index >= max_cells) {
+        return;
+    }
+    if (done == capacity) {
+        // drop the oldest move
+        first = (first + 1) % capacity;
+        --done;
+    }
+    ring[(first + done) % capacity] =
+        static_cast<uint16_t>(index) | (clockwise ? clockwise_bit : 0);
+    ++done;
+    total = done;
+}
+
+bool Journal::undo(size_t& index, bool& clockwise)
+{
+    if (!done) {
+        return false;
+    }
+    --done;
+    const uint16_t move = ring[(first + done) % capacity];
+    index = move & ~clockwise_bit;
+    clockwise = !(move & clockwise_bit);
+    return true;
+}
+
+bool Journal::redo(size_t& index, bool& clockwise)
+{
+    if (done == total) {
+        return false;
+    }
+    const uint16_t move = ring[(first + done) % capacity];
+    ++done;
+    index = move & ~clockwise_bit;
+    clockwise = move & clockwise_bit;
+    return true;
+}
+
+size_t Journal::save(std::vector<uint16_t>& moves) const
+{
+    moves.resize(total);
+    for (size_t i = 0; i < total; ++i) {
+        moves[i] = ring[(first + i) % capacity];
+    }
+    return done;
+}
+
+bool Journal::load(const std::vector<uint16_t>& moves, size_t position,
+                   size_t cells)
+{
+    if (moves.size() > capacity || position > moves.size()) {
+        return false;
+    }
+    for (const uint16_t move : moves) {
+        if ((move & ~clockwise_bit) >= cells) {
+            return false;
+        }
+    }
+
+    first = 0;
+    done = position;
+    total = moves.size();
+    for (size_t i = 0; i < total; ++i) {
+        ring[i] = moves[i];
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: MIT
+// Journal of moves (undo/redo history).
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Journal of moves: ring buffer of rotations, each move takes 2 bytes.
+ * The oldest moves are dropped when the buffer is full.
+ */
+class Journal {
+public:
+    /** Max number of moves in the journal. */
+    static constexpr size_t capacity = 1024;
+    /** Max number of cells that can be addressed by the move. */
+    static constexpr size_t max_cells = 1 << 15;
+
+    Journal();
+
+    /** Remove all moves. */
+    void clear();
+
+    /**
+     * Register new move, drops all moves that can be redone.
+     * @param index index of the rotated cell
+     * @param clockwise rotate direction
+     */
+    void push(size_t index, bool clockwise);
+
+    /**
+     * Take the last move back.
+     * @param index output index of the cell to rotate
+     * @param clockwise output direction to rotate the cell back
+     * @return false if there is nothing to undo
+     */
+    bool undo(size_t& index, bool& clockwise);
+
+    /**
+     * Repeat the last undone move.
+     * @param index output index of the cell to rotate
+     * @param clockwise output rotate direction
+     * @return false if there is nothing to redo
+     */
+    bool redo(size_t& index, bool& clockwise);
+
+    /**
+     * Export moves.
+     * @param moves output array of packed moves, the oldest first
+     * @return number of moves that can be undone, others can be redone
+     */
+    size_t save(std::vector<uint16_t>& moves) const;
+
+    /**
+     * Import moves.
+     * @param moves array of packed moves, the oldest first
+     * @param position number of moves that can be undone
+     * @param cells total number of cells in the level
+     * @return false if moves are invalid
+     */
+    bool load(const std::vector<uint16_t>& moves, size_t position,
+              size_t cells);
+
+private:
+    uint16_t ring[capacity]; ///< Packed moves: cell index and direction
+    size_t first;            ///< Index of the oldest move
+    size_t done;             ///< Number of moves that can be undone
+    size_t total;            ///< Number of moves (done and undone)
+};
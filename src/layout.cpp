@@ -98,7 +98,7 @@ void Layout::update(size_t width, size_t height)
     const int btn_x = field.x + base_size * 3;
     const int btn_y = field.y + base_size * 1.4;
     const int btn_s = base_size * 0.8;
-    for (size_t i = 0; i < sizeof(lvlsize) / sizeof(lvlsize[0]); ++i) {
+    for (size_t i = 0; i < Level::sizes_num; ++i) {
         Checkbox& cb = lvlsize[i];
         cb->x = btn_x;
         cb->y = btn_y + btn_s * i + padding * i;
@@ -108,7 +108,8 @@ void Layout::update(size_t width, size_t height)
 
     // level mode buttons (settings specific)
     wrap->x = btn_x;
-    wrap->y = lvlsize[3]->y + lvlsize[3]->h + base_size / 2;
+    Checkbox& last = lvlsize[Level::sizes_num - 1];
+    wrap->y = last->y + last->h + base_size / 2;
     wrap->w = btn_s;
     wrap->h = btn_s;
 
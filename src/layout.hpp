@@ -6,6 +6,8 @@
 
 #include <SDL2/SDL.h>
 
+#include "level.hpp"
+
 /** Window layout. */
 class Layout {
 public:
@@ -54,9 +56,9 @@ public:
     Button lvlnext;
 
     // Settings specific
-    Checkbox lvlsize[4]; ///< Level sizes
-    Checkbox wrap;       ///< Wrap mode on/off
-    Checkbox sound;      ///< Sound control
-    Button skinprev;     ///< Load next skin
-    Button skinnext;     ///< Load previous skin
+    Checkbox lvlsize[Level::sizes_num]; ///< Level sizes
+    Checkbox wrap;                      ///< Wrap mode on/off
+    Checkbox sound;                     ///< Sound control
+    Button skinprev;                    ///< Load next skin
+    Button skinnext;                    ///< Load previous skin
 };
@@ -4,21 +4,52 @@
 
 #include "level.hpp"
 
-#include "mtrand.hpp"
+#include <algorithm>
+
+constexpr size_t Level::sizes[];
+
+/** Max number of changed cells tracked separately. */
+static constexpr size_t max_changes = 64;
 
 void Level::generate()
 {
-    mtrand::seed(id);
+    random.seed(id);
 
     // reset cells state
     cells.resize(width * height);
     std::fill(cells.begin(), cells.end(), Cell {});
+    rotations.clear();
 
     // install sender (server)
-    sender.x = mtrand::get(static_cast<size_t>(1), width - 1);
-    sender.y = mtrand::get(static_cast<size_t>(1), height - 1);
+    sender.x = random.get(static_cast<size_t>(1), width - 1);
+    sender.y = random.get(static_cast<size_t>(1), height - 1);
     get_cell(sender).object = Cell::Sender;
 
+    // receivers can't be installed near the sender
+    free_cells.reset(cells.size());
+    Position pos;
+    for (pos.x = sender.x - 1; pos.x <= sender.x + 1; ++pos.x) {
+        for (pos.y = sender.y - 1; pos.y <= sender.y + 1; ++pos.y) {
+            free_cells.erase(pos.x * height + pos.y);
+        }
+    }
+
+    // prepare path search buffers
+    steps.reserve(cells.size());
+    path.reserve(cells.size());
+    visited.assign(cells.size(), 0);
+    visit_mark = 0;
+
+    network.reserve(cells.size());
+    trace_network.reserve(cells.size());
+    trace_stack.reserve(cells.size());
+    retrace = true;
+    split = false;
+
+    changes.reserve(max_changes);
+    changes.clear();
+    changes_all = true;
+
     const size_t max_recievers = cells.size() / 5;
     recievers.clear();
     recievers.reserve(max_recievers);
@@ -33,14 +64,34 @@ bool Level::load(const std::string& dump)
         return false;
     }
 
+    // check the whole dump first: each cell must contain a rotated pipe
+    // of the generated level
+    for (size_t i = 0; i < width * height; ++i) {
+        const int c = dump[i] - 'A';
+        if (c < 0 || c >= (1 << 5)) {
+            return false;
+        }
+        Pipe pipe = cells[i].pipe;
+        size_t turns = 0;
+        while (pipe.sides != (c & 0xf) && turns < Side::max) {
+            pipe.rotate(true);
+            ++turns;
+        }
+        if (turns == Side::max) {
+            return false;
+        }
+    }
+
     for (size_t i = 0; i < width * height; ++i) {
         const char c = dump[i] - 'A';
         const bool lock = c & (1 << 4);
-        const size_t sides = c & 0xf;
+        const uint8_t sides = c & 0xf;
         cells[i].pipe.sides = sides;
         cells[i].locked = lock;
     }
 
+    retrace = true;
+
     return true;
 }
 
@@ -50,7 +101,7 @@ std::string Level::save() const
     dump.reserve(width * height);
 
     for (const Cell& cell : cells) {
-        const unsigned long long sides = cell.pipe.sides.to_ullong();
+        const char sides = cell.pipe.sides;
         const char lock = cell.locked ? (1 << 4) : 0;
         const char state = lock + sides;
         dump += 'A' + state;
@@ -59,61 +110,72 @@ std::string Level::save() const
     return dump;
 }
 
-void Level::update()
+void Level::update(uint64_t now)
 {
-    // update cells state
     state.rotation_complete = false;
-    state.rotation_active = false;
-    Position pos;
-    for (pos.y = 0; pos.y < height; ++pos.y) {
-        for (pos.x = 0; pos.x < width; ++pos.x) {
-            Cell& cell = get_cell(pos);
-            cell.active = (pos == sender);
-            switch (cell.update()) {
-                case Cell::RotationComplete:
-                    state.rotation_complete = true;
-                    break;
-                case Cell::Unchanged:
-                    break;
-                case Cell::RotationInProgress:
-                    state.rotation_active = true;
-                    break;
+
+    // update rotations, only cells in rotation are checked
+    size_t i = 0;
+    while (i < rotations.size()) {
+        const size_t index = rotations[i].index;
+        Cell& cell = cells[index];
+        if (rotations[i].update(cell.pipe, now) == Rotation::RotationComplete) {
+            state.rotation_complete = true;
+            cell.rotating = false;
+            changed(index);
+            rotations[i] = rotations.back();
+            rotations.pop_back();
+            if (!retrace && !split) {
+                connect({ index % width, index / width });
             }
+        } else {
+            ++i;
         }
     }
+    state.rotation_active = !rotations.empty();
 
-    // trace from sender
-    if (!get_cell(sender).rotation()) {
-        trace_state(sender);
+    // trace the network once for all changes since the last update
+    if (retrace) {
+        for (auto& it : cells) {
+            it.active = false;
+        }
+        network.clear();
+        active_recievers = 0;
+        trace();
+        changes.clear();
+        changes_all = true;
+    } else if (split) {
+        disconnect();
     }
+    retrace = false;
+    split = false;
 
     // check completion status
-    state.level_complete = true;
-    for (const auto& it : recievers) {
-        if (!get_cell(it).active) {
-            state.level_complete = false;
-            break;
-        }
-    }
+    state.level_complete = (active_recievers == recievers.size());
 }
 
-void Level::reset()
+void Level::reset(uint64_t now)
 {
-    for (auto& it : cells) {
-        if (it.pipe != Pipe::None && !it.locked) {
-            const bool clockwize = mtrand::get(0, 2);
-            size_t count = mtrand::get(0, 3);
+    for (size_t i = 0; i < cells.size(); ++i) {
+        const Cell& cell = cells[i];
+        if (cell.pipe != Pipe::None && !cell.locked) {
+            const bool clockwize = random.get(0, 2);
+            size_t count = random.get(0, 3);
             while (count--) {
-                it.rotate(clockwize);
+                start_rotation(i, clockwize, now);
             }
         }
     }
+    retrace = true;
 }
 
-void Level::rotate(const Position& pos, bool clockwise)
+void Level::rotate(const Position& pos, bool clockwise, uint64_t now)
 {
-    get_cell(pos).rotate(clockwise);
-    update();
+    const Cell& cell = get_cell(pos);
+    if (!cell.rotating && cell.active) {
+        split = true; // network is retraced by the next update
+    }
+    start_rotation(pos.y * width + pos.x, clockwise, now);
 }
 
 Cell& Level::get_cell(const Position& pos)
@@ -126,38 +188,44 @@ const Cell& Level::get_cell(const Position& pos) const
     return cells[pos.y * width + pos.x];
 }
 
-void Level::add_reciever()
+bool Level::take_changes(std::vector<size_t>& changed)
+{
+    const bool partial = !changes_all;
+    if (partial) {
+        changed.insert(changed.end(), changes.begin(), changes.end());
+    }
+    changes.clear();
+    changes_all = false;
+    return partial;
+}
+
+const Rotation* Level::get_rotation(const Position& pos) const
 {
-    // get free cells
-    std::vector<Position> free_cells;
-    free_cells.reserve(width * height);
-    Position free_cell;
-    for (free_cell.x = 0; free_cell.x < width; ++free_cell.x) {
-        for (free_cell.y = 0; free_cell.y < height; ++free_cell.y) {
-            const Cell& cell = get_cell(free_cell);
-            if (cell.object == Cell::Empty && cell.pipe == Pipe::None &&
-                (std::abs(static_cast<ssize_t>(free_cell.x) -
-                          static_cast<ssize_t>(sender.x)) > 1 ||
-                 std::abs(static_cast<ssize_t>(free_cell.y) -
-                          static_cast<ssize_t>(sender.y)) > 1)) {
-                free_cells.push_back(free_cell);
+    const size_t index = pos.y * width + pos.x;
+    if (cells[index].rotating) {
+        for (const Rotation& it : rotations) {
+            if (it.index == index) {
+                return &it;
             }
         }
     }
-    if (free_cells.empty()) {
+    return nullptr;
+}
+
+void Level::add_reciever()
+{
+    if (free_cells.size() == 0) {
         return;
     }
 
     // get random position
     const size_t free_index =
-        mtrand::get(static_cast<size_t>(0), free_cells.size());
-    const Position& reciever = free_cells[free_index];
+        random.get(static_cast<size_t>(0), free_cells.size());
+    const size_t cell_index = free_cells.at(free_index);
+    const Position reciever = { cell_index / height, cell_index % height };
 
     // find path from receiver to sender
-    Path path;
-    std::set<Position> vizited;
-    vizited.insert(reciever);
-    if (!find_path(reciever, vizited, path)) {
+    if (!find_path(reciever, path)) {
         return;
     }
     // update level
@@ -166,62 +234,39 @@ void Level::add_reciever()
     recievers.push_back(reciever);
 }
 
-bool Level::find_path(const Position& from, std::set<Position>& vizited,
-                      Path& path) const
+bool Level::find_path(const Position& from, Path& path)
 {
-    // define order of possible directions
-    std::vector<Side> sides;
-    sides.reserve(4);
+    // start new search
+    if (++visit_mark == 0) {
+        std::fill(visited.begin(), visited.end(), 0);
+        visit_mark = 1;
+    }
+    visit_count = 0;
+    steps.clear();
+    path.clear();
 
-    if (vizited.size() < std::min(width, height)) {
-        // random directions
-        sides.push_back(Side::Left);
-        sides.push_back(Side::Right);
-        sides.push_back(Side::Top);
-        sides.push_back(Side::Bottom);
-        for (size_t i = 0; i < 4; ++i) {
-            const size_t i0 = mtrand::get(static_cast<size_t>(0), sides.size());
-            const size_t i1 = mtrand::get(static_cast<size_t>(0), sides.size());
-            std::iter_swap(sides.begin() + i0, sides.begin() + i1);
-        }
-    } else {
-        // shortest path
-        const ssize_t delta_x = sender.x - from.x;
-        const ssize_t delta_y = sender.y - from.y;
-        if (std::abs(delta_x) > std::abs(delta_y)) {
-            sides.push_back(delta_x < 0 ? Side::Left : Side::Right);
-            sides.push_back(delta_y < 0 ? Side::Top : Side::Bottom);
-            sides.push_back(delta_y >= 0 ? Side::Top : Side::Bottom);
-            sides.push_back(delta_x >= 0 ? Side::Left : Side::Right);
-        } else {
-            sides.push_back(delta_y < 0 ? Side::Top : Side::Bottom);
-            sides.push_back(delta_x < 0 ? Side::Left : Side::Right);
-            sides.push_back(delta_x >= 0 ? Side::Left : Side::Right);
-            sides.push_back(delta_y >= 0 ? Side::Top : Side::Bottom);
-        }
-        // check for possible forks
-        for (const Side side : sides) {
-            const Position next_pos = neighbor(from, side);
-            if (next_pos != from) {
-                const Cell& next_cell = get_cell(next_pos);
-                if (next_cell.object == Cell::Empty &&
-                    next_cell.pipe != Pipe::None &&
-                    next_cell.pipe != Pipe::Fork) {
-                    path.push_back(side);
-                    return true;
-                }
+    visit(from);
+    if (push_step(from, path)) {
+        return true;
+    }
+
+    while (!steps.empty()) {
+        Step& step = steps.back();
+        if (step.next == step.count) {
+            // dead end, go back and try another direction
+            steps.pop_back();
+            if (!steps.empty()) {
+                path.pop_back();
             }
+            continue;
         }
-    }
 
-    // go through possible directions
-    for (const Side& side : sides) {
-        const Position next_pos = neighbor(from, side);
-        if (vizited.find(next_pos) != vizited.end()) {
+        const Side side = step.sides[step.next++];
+        const Position next_pos = neighbor(step.pos, side);
+        if (!visit(next_pos)) {
             continue; // already visited
         }
 
-        vizited.insert(next_pos);
         path.push_back(side);
 
         // try to connect with the neighbor
@@ -233,9 +278,10 @@ bool Level::find_path(const Position& from, std::set<Position>& vizited,
             if (next_cell.pipe != Pipe::None) {
                 return true; // fork: connect to existing pipe
             }
-            if (find_path(next_pos, vizited, path)) {
+            if (push_step(next_pos, path)) {
                 return true; // route found
             }
+            continue; // go deeper
         }
 
         // remove current step and try another direction
@@ -245,42 +291,208 @@ bool Level::find_path(const Position& from, std::set<Position>& vizited,
     return false;
 }
 
+bool Level::push_step(const Position& pos, Path& path)
+{
+    Step step;
+    step.pos = pos;
+    step.count = 0;
+    step.next = 0;
+
+    // define order of possible directions
+    if (visit_count < std::min(width, height)) {
+        // random directions
+        step.sides[step.count++] = Side::Left;
+        step.sides[step.count++] = Side::Right;
+        step.sides[step.count++] = Side::Top;
+        step.sides[step.count++] = Side::Bottom;
+        for (size_t i = 0; i < 4; ++i) {
+            const size_t i0 = random.get(static_cast<size_t>(0),
+                                         static_cast<size_t>(step.count));
+            const size_t i1 = random.get(static_cast<size_t>(0),
+                                         static_cast<size_t>(step.count));
+            std::swap(step.sides[i0], step.sides[i1]);
+        }
+    } else {
+        // shortest path
+        const ssize_t delta_x = sender.x - pos.x;
+        const ssize_t delta_y = sender.y - pos.y;
+        if (std::abs(delta_x) > std::abs(delta_y)) {
+            step.sides[step.count++] = delta_x < 0 ? Side::Left : Side::Right;
+            step.sides[step.count++] = delta_y < 0 ? Side::Top : Side::Bottom;
+            step.sides[step.count++] = delta_y >= 0 ? Side::Top : Side::Bottom;
+            step.sides[step.count++] = delta_x >= 0 ? Side::Left : Side::Right;
+        } else {
+            step.sides[step.count++] = delta_y < 0 ? Side::Top : Side::Bottom;
+            step.sides[step.count++] = delta_x < 0 ? Side::Left : Side::Right;
+            step.sides[step.count++] = delta_x >= 0 ? Side::Left : Side::Right;
+            step.sides[step.count++] = delta_y >= 0 ? Side::Top : Side::Bottom;
+        }
+        // check for possible forks
+        for (size_t i = 0; i < step.count; ++i) {
+            const Side side = step.sides[i];
+            const Position next_pos = neighbor(pos, side);
+            if (next_pos != pos) {
+                const Cell& next_cell = get_cell(next_pos);
+                if (next_cell.object == Cell::Empty &&
+                    next_cell.pipe != Pipe::None &&
+                    next_cell.pipe != Pipe::Fork) {
+                    path.push_back(side);
+                    return true;
+                }
+            }
+        }
+    }
+
+    steps.push_back(step);
+
+    return false;
+}
+
+bool Level::visit(const Position& pos)
+{
+    uint32_t& mark = visited[pos.y * width + pos.x];
+    if (mark == visit_mark) {
+        return false;
+    }
+    mark = visit_mark;
+    ++visit_count;
+    return true;
+}
+
 void Level::apply_path(const Position& start, const Level::Path& path)
 {
     Position pos = start;
     for (const Side side : path) {
         get_cell(pos).pipe.set(side);
+        free_cells.erase(pos.x * height + pos.y);
         pos = neighbor(pos, side);
         get_cell(pos).pipe.set(side.opposite());
+        free_cells.erase(pos.x * height + pos.y);
+    }
+}
+
+void Level::start_rotation(size_t index, bool clockwise, uint64_t now)
+{
+    Cell& cell = cells[index];
+
+    if (cell.rotating) {
+        for (Rotation& it : rotations) {
+            if (it.index == index) {
+                it.rotate(cell.pipe, clockwise, now);
+                break;
+            }
+        }
+    } else {
+        rotations.push_back(Rotation(index, cell.pipe, clockwise, now));
+        cell.rotating = true;
+        changed(index);
+    }
+}
+
+void Level::changed(size_t index)
+{
+    if (!changes_all) {
+        if (changes.size() < max_changes) {
+            changes.push_back(index);
+        } else {
+            // too many changes to track them separately
+            changes.clear();
+            changes_all = true;
+        }
     }
 }
 
 void Level::trace_state(const Position& start)
 {
-    Position curr_pos = start;
+    // each cell is activated before it is pushed, so the stack can't grow
+    // larger than the number of cells (capacity is reserved in generate())
+    activate(start);
+    trace_stack.clear();
+    trace_stack.push_back(start);
 
-    while (true) {
-        Cell& curr_cell = get_cell(curr_pos);
-        curr_cell.active = true;
+    while (!trace_stack.empty()) {
+        const Position curr_pos = trace_stack.back();
+        trace_stack.pop_back();
 
-        // get possible ways
-        std::vector<Position> connected;
-        for (const Side side : curr_cell.pipe.connections()) {
+        for (const Side side : get_cell(curr_pos).pipe.connections()) {
             const Position next_pos = neighbor(curr_pos, side);
             const Cell& next_cell = get_cell(next_pos);
-            if (next_pos != curr_pos && !next_cell.rotation() &&
+            if (next_pos != curr_pos && !next_cell.rotating &&
                 !next_cell.active && next_cell.pipe.get(side.opposite())) {
-                connected.push_back(next_pos);
+                activate(next_pos);
+                trace_stack.push_back(next_pos);
             }
         }
-        if (connected.empty()) {
+    }
+}
+
+void Level::trace()
+{
+    activate(sender); // sender is always active
+    if (!get_cell(sender).rotating) {
+        trace_state(sender);
+    }
+}
+
+void Level::connect(const Position& pos)
+{
+    bool linked = (pos == sender);
+
+    // check if the cell is connected to any active neighbor
+    for (const Side side : get_cell(pos).pipe.connections()) {
+        if (linked) {
             break;
         }
+        const Position next_pos = neighbor(pos, side);
+        const Cell& next_cell = get_cell(next_pos);
+        linked = next_pos != pos && next_cell.active &&
+            !next_cell.rotating && next_cell.pipe.get(side.opposite());
+    }
+
+    if (linked) {
+        // network can only grow, new cells are appended to the list
+        const size_t first = network.size();
+        trace_state(pos);
+        for (size_t i = first; i < network.size(); ++i) {
+            changed(network[i]);
+        }
+    }
+}
 
-        curr_pos = connected[0];
+void Level::disconnect()
+{
+    // network can be split: retrace it, but only cells that were connected
+    // need to be reset, they are marked to find the changed ones
+    ++visit_mark;
+    for (const size_t index : network) {
+        cells[index].active = false;
+        visited[index] = visit_mark;
+    }
+    network.swap(trace_network);
+    network.clear();
+    active_recievers = 0;
+    trace();
+
+    for (const size_t index : trace_network) {
+        if (!cells[index].active) {
+            changed(index); // disconnected
+        }
+    }
+    for (const size_t index : network) {
+        if (visited[index] != visit_mark) {
+            changed(index); // connected
+        }
+    }
+}
 
-        if (connected.size() > 1) { // fork
-            trace_state(connected[1]);
+void Level::activate(const Position& pos)
+{
+    Cell& cell = get_cell(pos);
+    if (!cell.active) {
+        cell.active = true;
+        network.push_back(pos.y * width + pos.x);
+        if (cell.object == Cell::Receiver) {
+            ++active_recievers;
         }
     }
 }
@@ -322,3 +534,50 @@ Position Level::neighbor(const Position& from, Side to) const
 
     return next;
 }
+
+void Level::FreeCells::reset(size_t size)
+{
+    present.assign(size, 1);
+    count = size;
+
+    // build tree in linear time, the tree is 1-based
+    tree.assign(size + 1, 1);
+    tree[0] = 0;
+    for (size_t i = 1; i <= size; ++i) {
+        const size_t parent = i + (i & (~i + 1));
+        if (parent <= size) {
+            tree[parent] += tree[i];
+        }
+    }
+}
+
+void Level::FreeCells::erase(size_t index)
+{
+    if (index >= present.size() || !present[index]) {
+        return;
+    }
+    present[index] = 0;
+    --count;
+    for (size_t i = index + 1; i < tree.size(); i += i & (~i + 1)) {
+        --tree[i];
+    }
+}
+
+size_t Level::FreeCells::at(size_t nth) const
+{
+    // descend the tree from the highest power of two
+    size_t step = 1;
+    while (step * 2 < tree.size()) {
+        step *= 2;
+    }
+    size_t pos = 0;
+    size_t rest = nth;
+    for (; step; step /= 2) {
+        const size_t next = pos + step;
+        if (next < tree.size() && tree[next] <= rest) {
+            pos = next;
+            rest -= tree[next];
+        }
+    }
+    return pos; // next 1-based position is the element, i.e. its index
+}
@@ -5,10 +5,11 @@
 #pragma once
 
 #include <cstdint>
-#include <set>
+#include <string>
 #include <vector>
 
 #include "cell.hpp"
+#include "mtrand.hpp"
 
 /** Game level. */
 class Level {
@@ -19,14 +20,18 @@ public:
     static constexpr size_t min_size = 10;
     /** Maximum level size. */
     static constexpr size_t max_size = 50;
+    /** Level sizes (width and height) available in the game settings. */
+    static constexpr size_t sizes[] = { 10, 15, 20, 30 };
+    /** Number of available level sizes. */
+    static constexpr size_t sizes_num = sizeof(sizes) / sizeof(sizes[0]);
 
     /** Generate new level. */
     void generate();
 
     /**
-     * Load cell state.
+     * Load cell state, the level must be generated before.
      * @param dump serialized state of all cells
-     * @return loading status
+     * @return false if dump doesn't match the generated level
      */
     bool load(const std::string& dump);
 
@@ -36,29 +41,63 @@ public:
      */
     std::string save() const;
 
-    /** Update level status: trace through pipes, refresh status, etc. */
-    void update();
+    /**
+     * Update level status: handle rotations, trace through pipes, etc.
+     * Network state is updated incrementally, the full trace is done only
+     * after the level was (re)generated, loaded or reset. Network changes
+     * made by rotate() calls since the last update are traced at once.
+     * @param now current timestamp
+     */
+    void update(uint64_t now);
 
-    /** Reset state (randomly rotate pipes). */
-    void reset();
+    /**
+     * Reset state (randomly rotate pipes).
+     * @param now current timestamp
+     */
+    void reset(uint64_t now);
 
     /**
-     * Initiate pipe rotation.
+     * Initiate pipe rotation, the network is updated by the next update().
      * @param pos cell position
      * @param clockwise rotate direction
+     * @param now current timestamp
      */
-    void rotate(const Position& pos, bool clockwise);
+    void rotate(const Position& pos, bool clockwise, uint64_t now);
 
     /** Get cell instance for specified position. */
     Cell& get_cell(const Position& pos);
     const Cell& get_cell(const Position& pos) const;
 
+    /**
+     * Get rotation animation of the cell at specified position.
+     * @param pos cell position
+     * @return pointer to the rotation, nullptr if cell is not rotating
+     */
+    const Rotation* get_rotation(const Position& pos) const;
+
+    /**
+     * Take cells that look different since the last call: rotation was
+     * started or finished, connection state was changed.
+     * @param changed array to append indices of the changed cells
+     * @return false if the whole level was changed
+     */
+    bool take_changes(std::vector<size_t>& changed);
+
+    /**
+     * Get position of neighbor cell.
+     * @param from origin position
+     * @param to neighbor's side
+     * @return neighbor position, can be the same as "from"
+     */
+    Position neighbor(const Position& from, Side to) const;
+
     uint32_t id;                     ///< Map Id
     size_t width;                    ///< Field width
     size_t height;                   ///< Field height
     bool wrap;                       ///< Wrap mode flag
     Position sender;                 ///< Sender coordinate (zero patient)
     std::vector<Cell> cells;         ///< Cells array
+    std::vector<Rotation> rotations; ///< Rotations in progress
     std::vector<Position> recievers; ///< Receivers array
 
     struct State {
@@ -70,18 +109,77 @@ public:
 private:
     using Path = std::vector<Side>;
 
+    /** Single step of the path search. */
+    struct Step {
+        Position pos;                ///< Cell position
+        Side::Type sides[Side::max]; ///< Directions to check
+        uint8_t count;               ///< Number of directions
+        uint8_t next;                ///< Index of the next direction to check
+    };
+
+    /**
+     * Set of cells available for new receivers.
+     * Cells are ordered by index, the set supports fast removing and
+     * access to the n-th element (Fenwick tree).
+     */
+    class FreeCells {
+    public:
+        /**
+         * Reset set: fill with all cells.
+         * @param size total number of cells
+         */
+        void reset(size_t size);
+
+        /**
+         * Remove cell from the set.
+         * @param index cell index
+         */
+        void erase(size_t index);
+
+        /**
+         * Get cell index by its position in the set.
+         * @param nth position in the set [0, size)
+         * @return cell index
+         */
+        size_t at(size_t nth) const;
+
+        /**
+         * Get number of cells in the set.
+         * @return number of cells
+         */
+        inline size_t size() const { return count; }
+
+    private:
+        std::vector<uint8_t> present; ///< Flags of cells presence
+        std::vector<uint32_t> tree;   ///< Fenwick tree of presence flags
+        size_t count;                 ///< Number of cells in the set
+    };
+
     /** Add one more receiver to level. */
     void add_reciever();
 
     /**
      * Find path from specified position to the sender.
      * @param from position to start
-     * @param visited set of visited cells
      * @param path array of directions
      * @return true if path found
      */
-    bool find_path(const Position& from, std::set<Position>& vizited,
-                   Path& path) const;
+    bool find_path(const Position& from, Path& path);
+
+    /**
+     * Put new step on the path search stack.
+     * @param pos position of the cell
+     * @param path array of directions
+     * @return true if the step is connected to the existing pipe
+     */
+    bool push_step(const Position& pos, Path& path);
+
+    /**
+     * Mark cell as visited by current path search.
+     * @param pos position of the cell
+     * @return false if the cell was already visited
+     */
+    bool visit(const Position& pos);
 
     /**
      * Apply path as pipes to the level map.
@@ -90,6 +188,14 @@ private:
      */
     void apply_path(const Position& start, const Path& path);
 
+    /**
+     * Start pipe rotation or update the one in progress.
+     * @param index cell index
+     * @param clockwise rotate direction
+     * @param now current timestamp
+     */
+    void start_rotation(size_t index, bool clockwise, uint64_t now);
+
     /**
      * Trace pipes: sets 'active' status for connected cells.
      * @param pos position to start
@@ -97,10 +203,46 @@ private:
     void trace_state(const Position& pos);
 
     /**
-     * Get position of neighbor cell.
-     * @param from origin position
-     * @param to neighbor's side
-     * @return neighbor position, can be the same as "from"
+     * Register changed cell, see take_changes().
+     * @param index cell index
      */
-    Position neighbor(const Position& from, Side to) const;
+    void changed(size_t index);
+
+    /** Trace whole network from the sender. */
+    void trace();
+
+    /**
+     * Connect cell to the network after its rotation is complete.
+     * @param pos cell position
+     */
+    void connect(const Position& pos);
+
+    /** Retrace the network after rotation start of connected cells. */
+    void disconnect();
+
+    /**
+     * Set 'active' status for the cell.
+     * @param pos cell position
+     */
+    void activate(const Position& pos);
+
+    MtRand random; ///< PRNG used for generation and reset, seeded by id
+
+    std::vector<size_t> network;       ///< Cells with 'active' status
+    std::vector<size_t> trace_network; ///< Network before the retrace
+    std::vector<Position> trace_stack; ///< Stack of cells to trace
+    size_t active_recievers;           ///< Number of active receivers
+    bool retrace;                      ///< Full trace is required
+    bool split;                        ///< Connected cell started rotation
+
+    std::vector<size_t> changes; ///< Cells changed since the last take
+    bool changes_all;            ///< Whole level was changed
+
+    FreeCells free_cells; ///< Cells available for receivers (column-major)
+
+    std::vector<Step> steps;       ///< Path search stack
+    Path path;                     ///< Path search result
+    std::vector<uint32_t> visited; ///< Visit marks (path search, network)
+    uint32_t visit_mark;           ///< Mark of the current visit
+    size_t visit_count;            ///< Number of visited cells
 };
@@ -11,93 +11,190 @@
 #include <cstdlib>
 
 #include "game.hpp"
+#include "generator.hpp"
+#include "pacer.hpp"
+#include "profiler.hpp"
 
-/** Run game. */
-bool run(State& state)
+/**
+ * Play the game: main loop.
+ * The game is destroyed on return, so its background threads are stopped
+ * before SDL is shut down.
+ * @param window game window
+ * @param render renderer instance
+ * @param state game state
+ * @param trace path to the frame time trace file, nullptr to disable
+ * @return false if something went wrong
+ */
+static bool play(SDL_Window* window, SDL_Renderer* render, State& state,
+                 const char* trace)
 {
-    // initialize SDL
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        printf("Couldn't initialize SDL: %s\n", SDL_GetError());
-        return false;
-    }
-    IMG_Init(IMG_INIT_PNG);
+    // setup frame pacing
+    SDL_RendererInfo info;
+    const bool vsync = SDL_GetRendererInfo(render, &info) == 0 &&
+        (info.flags & SDL_RENDERER_PRESENTVSYNC);
+    FramePacer pacer;
+    pacer.initialize(window, vsync);
 
-    // create window
-    SDL_Window* window = SDL_CreateWindow("PipeWalker", SDL_WINDOWPOS_UNDEFINED,
-                                          SDL_WINDOWPOS_UNDEFINED, 480, 600,
-                                          SDL_WINDOW_RESIZABLE);
-    if (!window) {
-        printf("Failed to create window: %s\n", SDL_GetError());
+    // initialize game
+    SystemClock clock;
+    clock.tick();
+    Game game(window, render, clock);
+    if (!game.initialize(state)) {
         return false;
     }
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
 
-    // create renderer
-    SDL_Renderer* render =
-        SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!render) {
-        printf("Failed to create renderer: %s\n", SDL_GetError());
-        return false;
-    }
-
-    // initialize game
-    Game game(window, render);
-    if (!game.initialize(state)) {
+    Profiler profiler;
+    if (trace && !profiler.open_trace(trace)) {
+        printf("Failed to create trace file %s\n", trace);
         return false;
     }
 
     // main game loop
     bool quit = false;
     while (!quit) {
+        clock.tick(); // single timestamp for the whole frame
+        pacer.begin();
+        profiler.begin_frame();
+        profiler.start(Profiler::Events);
+        bool clicked = false;
+        uint32_t click_time = 0;
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
-            if (event.type != SDL_QUIT) {
-                game.handle_event(event);
-            } else {
+            if (event.type == SDL_QUIT) {
                 quit = true;
                 break;
             }
+            if (event.type == SDL_MOUSEBUTTONDOWN && !clicked) {
+                clicked = true; // the earliest click of the frame
+                click_time = event.button.timestamp;
+            }
+            if (event.type == SDL_KEYDOWN &&
+                event.key.keysym.sym == SDLK_F3) {
+                profiler.overlay = !profiler.overlay;
+            } else {
+                if (event.type == SDL_WINDOWEVENT &&
+                    event.window.event == SDL_WINDOWEVENT_DISPLAY_CHANGED) {
+                    pacer.initialize(window, vsync); // new refresh rate
+                }
+                game.handle_event(event);
+            }
         }
+        profiler.stop(Profiler::Events);
         if (!quit) {
+            profiler.start(Profiler::Update);
             const bool animate = game.update();
+            profiler.stop(Profiler::Update);
+
+            profiler.start(Profiler::Draw);
             game.draw();
+            if (profiler.overlay) {
+                game.draw_overlay(profiler.summary());
+            }
+            profiler.stop(Profiler::Draw);
+            pacer.drawn();
+
+            profiler.start(Profiler::Flush);
+            game.flush();
+            profiler.stop(Profiler::Flush);
+            if (clicked) {
+                profiler.input(SDL_GetTicks() - click_time);
+            }
+            profiler.audio(game.audio_latency_estimate());
+
+            const bool late = !pacer.finish();
+            const Render::Stats& stats = game.render_stats();
+            profiler.end_frame(clock.now(), stats.draw_calls,
+                               stats.texture_switches, late);
+
             if (animate) {
-                SDL_Delay(1000 / 60); // 60 fps
+                pacer.wait();
             } else {
                 SDL_WaitEvent(nullptr);
+                pacer.restart();
             }
         }
     }
 
     game.save(state);
 
+    return true;
+}
+
+/**
+ * Run game.
+ * @param state game state
+ * @param trace path to the frame time trace file, nullptr to disable
+ * @return false if something went wrong
+ */
+bool run(State& state, const char* trace)
+{
+    // initialize SDL
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        printf("Couldn't initialize SDL: %s\n", SDL_GetError());
+        return false;
+    }
+    IMG_Init(IMG_INIT_PNG);
+
+    // create window
+    SDL_Window* window = SDL_CreateWindow("PipeWalker", SDL_WINDOWPOS_UNDEFINED,
+                                          SDL_WINDOWPOS_UNDEFINED, 480, 600,
+                                          SDL_WINDOW_RESIZABLE);
+    if (!window) {
+        printf("Failed to create window: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+
+    // create renderer, use software one if there is no GPU
+    SDL_Renderer* render = SDL_CreateRenderer(
+        window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (!render) {
+        render = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    }
+    if (!render) {
+        printf("Failed to create renderer: %s\n", SDL_GetError());
+        return false;
+    }
+
+    const bool rc = play(window, render, state, trace);
+
     // clean up
     SDL_DestroyRenderer(render);
     SDL_DestroyWindow(window);
     IMG_Quit();
     SDL_Quit();
 
-    return true;
+    return rc;
 }
 
 /** Application entry point. */
 int main(int argc, char* argv[])
 {
-    State state;
-    state.load();
+    // options override the saved state, 0 means "not set"
+    uint32_t level_id = 0;
+    size_t level_width = 0;
+    size_t level_height = 0;
+    bool no_wrap = false;
+    bool no_sound = false;
+
+    uint32_t gen_first = 0;
+    uint32_t gen_last = 0;
+    const char* trace = nullptr;
 
     // clang-format off
     const struct option long_opts[] = {
-        { "id",       required_argument, nullptr, 'i' },
-        { "width",    required_argument, nullptr, 'c' },
-        { "height",   required_argument, nullptr, 'r' },
-        { "no-wrap",  no_argument,       nullptr, 'w' },
-        { "no-sound", no_argument,       nullptr, 's' },
-        { "version",  no_argument,       nullptr, 'v' },
-        { "help",     no_argument,       nullptr, 'h' },
+        { "id",             required_argument, nullptr, 'i' },
+        { "width",          required_argument, nullptr, 'c' },
+        { "height",         required_argument, nullptr, 'r' },
+        { "no-wrap",        no_argument,       nullptr, 'w' },
+        { "no-sound",       no_argument,       nullptr, 's' },
+        { "generate-range", required_argument, nullptr, 'g' },
+        { "trace",          required_argument, nullptr, 't' },
+        { "version",        no_argument,       nullptr, 'v' },
+        { "help",           no_argument,       nullptr, 'h' },
         { nullptr, 0, nullptr, 0 }
     };
-    const char* short_opts = "i:c:r:wsvh";
+    const char* short_opts = "i:c:r:wsg:t:vh";
     // clang-format on
 
     opterr = 0; // prevent native error messages
@@ -108,33 +205,49 @@ int main(int argc, char* argv[])
            -1) {
         switch (opt) {
             case 'i':
-                state.level_id = strtoul(optarg, nullptr, 0);
-                if (state.level_id <= 0 || state.level_id > Level::max_id) {
+                level_id = strtoul(optarg, nullptr, 0);
+                if (level_id <= 0 || level_id > Level::max_id) {
                     fprintf(stderr, "Invalid level id: %s\n", optarg);
                     return EXIT_FAILURE;
                 }
                 break;
             case 'c':
-                state.level_width = strtoul(optarg, nullptr, 0);
-                if (state.level_width < Level::min_size ||
-                    state.level_width > Level::max_size) {
+                level_width = strtoul(optarg, nullptr, 0);
+                if (level_width < Level::min_size ||
+                    level_width > Level::max_size) {
                     fprintf(stderr, "Invalid level width: %s\n", optarg);
                     return EXIT_FAILURE;
                 }
                 break;
             case 'r':
-                state.level_height = strtoul(optarg, nullptr, 0);
-                if (state.level_height < Level::min_size ||
-                    state.level_height > Level::max_size) {
+                level_height = strtoul(optarg, nullptr, 0);
+                if (level_height < Level::min_size ||
+                    level_height > Level::max_size) {
                     fprintf(stderr, "Invalid level height: %s\n", optarg);
                     return EXIT_FAILURE;
                 }
                 break;
             case 'w':
-                state.level_wrap = false;
+                no_wrap = true;
                 break;
             case 's':
-                state.sound = false;
+                no_sound = true;
+                break;
+            case 'g': {
+                char* end = nullptr;
+                gen_first = strtoul(optarg, &end, 0);
+                gen_last = gen_first;
+                if (*end == '-') {
+                    gen_last = strtoul(end + 1, &end, 0);
+                }
+                if (*end || gen_first <= 0 || gen_last > Level::max_id ||
+                    gen_first > gen_last) {
+                    fprintf(stderr, "Invalid range of levels: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+            } break;
+            case 't':
+                trace = optarg;
                 break;
             case 'v':
                 printf("PipeWalker game version " APP_VERSION ".\n");
@@ -150,6 +263,9 @@ int main(int argc, char* argv[])
                        Level::min_size, Level::max_size);
                 puts("  -w, --no-wrap        disable warp mode");
                 puts("  -s, --no-sound       disable sound");
+                puts("  -g, --generate-range=FIRST[-LAST]");
+                puts("                       print generated levels and exit");
+                puts("  -t, --trace=FILE     write frame times to CSV file");
                 puts("  -v, --version        print version info and exit");
                 puts("  -h, --help           print this help and exit");
                 return EXIT_SUCCESS;
@@ -163,7 +279,36 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
-    const bool rc = run(state);
+    // headless mode doesn't use the saved state to make output reproducible
+    State state;
+    if (!gen_first) {
+        state.load();
+    }
+    if (level_id) {
+        state.level_id = level_id;
+    }
+    if (level_width) {
+        state.level_width = level_width;
+    }
+    if (level_height) {
+        state.level_height = level_height;
+    }
+    if (no_wrap) {
+        state.level_wrap = false;
+    }
+    if (no_sound) {
+        state.sound = false;
+    }
+
+    if (gen_first) {
+        // headless mode: generate levels without window
+        Generator generator(state.level_width, state.level_height,
+                            state.level_wrap);
+        return generator.run(gen_first, gen_last, stdout) ? EXIT_SUCCESS
+                                                          : EXIT_FAILURE;
+    }
+
+    const bool rc = run(state, trace);
     if (rc) {
         state.save();
     }
@@ -4,40 +4,20 @@
 
 #include "mtrand.hpp"
 
-namespace mtrand {
-
-/** Number of iterations for MT19937. */
-static constexpr const uint32_t iter_num = 624;
-/** Middle word number. */
-static constexpr const uint32_t middle = 397;
-/** State array. */
-static uint32_t states[iter_num];
-/** Current state array index. */
-static uint32_t state_index;
-
 /** Twiddle state. */
-constexpr uint32_t twiddle(uint32_t u, uint32_t v)
+static inline uint32_t twiddle(uint32_t u, uint32_t v)
 {
+    // branchless variant of "(v & 1) ? 0x9908b0df : 0"
     return (((u & 0x80000000UL) | (v & 0x7fffffffUL)) >> 1) ^
-        ((v & 1UL) ? 0x9908b0dfUL : 0x0UL);
+        ((0UL - (v & 1UL)) & 0x9908b0dfUL);
 }
 
-/** Regenerate state array. */
-static void generate_state()
+MtRand::MtRand(uint32_t seed)
 {
-    for (uint32_t i = 0; i < iter_num - middle; ++i) {
-        states[i] = states[i + middle] ^ twiddle(states[i], states[i + 1]);
-    }
-    for (uint32_t i = iter_num - middle; i < iter_num - 1; ++i) {
-        states[i] =
-            states[i + middle - iter_num] ^ twiddle(states[i], states[i + 1]);
-    }
-    states[iter_num - 1] =
-        states[middle - 1] ^ twiddle(states[iter_num - 1], states[0]);
-    state_index = 0;
+    this->seed(seed);
 }
 
-void seed(uint32_t seed)
+void MtRand::seed(uint32_t seed)
 {
     states[0] = seed;
     for (uint32_t i = 1; i < iter_num; ++i) {
@@ -46,16 +26,35 @@ void seed(uint32_t seed)
     state_index = iter_num; // force regenerate state array
 }
 
-uint32_t get()
+uint32_t MtRand::get()
 {
     if (state_index == iter_num) {
-        generate_state(); // new state array is needed
+        generate_state(); // new block of numbers is needed
     }
-    uint32_t n = states[state_index++];
-    n ^= (n >> 11);
-    n ^= (n << 7) & 0x9d2c5680UL;
-    n ^= (n << 15) & 0xefc60000UL;
-    return (n ^ (n >> 18));
+    return output[state_index++];
 }
 
-} // namespace mtrand
+void MtRand::generate_state()
+{
+    for (uint32_t i = 0; i < iter_num - middle; ++i) {
+        states[i] = states[i + middle] ^ twiddle(states[i], states[i + 1]);
+    }
+    for (uint32_t i = iter_num - middle; i < iter_num - 1; ++i) {
+        states[i] =
+            states[i + middle - iter_num] ^ twiddle(states[i], states[i + 1]);
+    }
+    states[iter_num - 1] =
+        states[middle - 1] ^ twiddle(states[iter_num - 1], states[0]);
+
+    // temper the whole block at once: the words are independent, so the
+    // loop is vectorized and get() is reduced to a single load
+    for (uint32_t i = 0; i < iter_num; ++i) {
+        uint32_t n = states[i];
+        n ^= (n >> 11);
+        n ^= (n << 7) & 0x9d2c5680UL;
+        n ^= (n << 15) & 0xefc60000UL;
+        output[i] = n ^ (n >> 18);
+    }
+
+    state_index = 0;
+}
@@ -6,29 +6,48 @@
 
 #include <cstdint>
 
-namespace mtrand {
-
-/**
- * Set new seed for random sequence.
- * @param seed initial seed value
- */
-void seed(uint32_t seed);
-
-/**
- * Get random 32bit number.
- * @return random number.
- */
-uint32_t get();
-
-/**
- * Get float random number in range [min_val..max_val).
- * @param min_val min value
- * @param max_val max value
- * @return random value
- */
-template <typename T> T get(T min_val, T max_val)
-{
-    return min_val + (get() % (max_val - min_val));
-}
-
-} // namespace mtrand
+/** Mersenne Twister PRNG (MT19937), each instance has its own state. */
+class MtRand {
+public:
+    /**
+     * Constructor.
+     * @param seed initial seed value
+     */
+    MtRand(uint32_t seed = 5489);
+
+    /**
+     * Set new seed for random sequence.
+     * @param seed initial seed value
+     */
+    void seed(uint32_t seed);
+
+    /**
+     * Get random 32bit number.
+     * @return random number.
+     */
+    uint32_t get();
+
+    /**
+     * Get random number in range [min_val..max_val).
+     * @param min_val min value
+     * @param max_val max value
+     * @return random value
+     */
+    template <typename T> T get(T min_val, T max_val)
+    {
+        return min_val + (get() % (max_val - min_val));
+    }
+
+private:
+    /** Regenerate whole state array and temper it to the output block. */
+    void generate_state();
+
+    /** Number of iterations for MT19937. */
+    static constexpr uint32_t iter_num = 624;
+    /** Middle word number. */
+    static constexpr uint32_t middle = 397;
+
+    uint32_t states[iter_num]; ///< State array
+    uint32_t output[iter_num]; ///< Tempered numbers of the current state
+    uint32_t state_index;      ///< Current output index
+};
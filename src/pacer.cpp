@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: MIT
+// Frame pacer.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "pacer.hpp"
+
+#include <algorithm>
+
+/** Refresh rate used if the display doesn't report it. */
+static constexpr int default_rate = 60;
+
+/** Time reserved for scheduler jitter in microseconds. */
+static constexpr uint64_t safety_margin = 2000;
+
+FramePacer::FramePacer()
+    : frequency(SDL_GetPerformanceFrequency())
+    , period(1000000 / default_rate)
+    , deadline(0)
+    , start(0)
+    , work(0)
+    , vsync(false)
+    , restarted(false)
+{
+}
+
+void FramePacer::initialize(SDL_Window* window, bool vsync)
+{
+    int rate = 0;
+    SDL_DisplayMode mode;
+    const int display = SDL_GetWindowDisplayIndex(window);
+    if (display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0) {
+        rate = mode.refresh_rate;
+    }
+    if (rate <= 0) {
+        rate = default_rate;
+    }
+
+    this->vsync = vsync;
+    period = 1000000 / rate;
+    restart();
+}
+
+void FramePacer::begin()
+{
+    start = now();
+}
+
+void FramePacer::drawn()
+{
+    // follow spikes immediately, decay slowly
+    const uint64_t elapsed = now() - start;
+    work = std::max(elapsed, (work * 7 + elapsed) / 8);
+}
+
+bool FramePacer::finish()
+{
+    const uint64_t time = now();
+
+    // presenting with vsync blocks until the display refresh, so the frame
+    // is late only if it takes the next refresh; the first frame after idle
+    // is drawn on demand and can't be late
+    const bool late =
+        !restarted && time > deadline + (vsync ? period / 2 : 0);
+    if (late || vsync || restarted) {
+        deadline = time; // resync with the last present
+    }
+    restarted = false;
+
+    return !late;
+}
+
+void FramePacer::wait()
+{
+    deadline += period;
+
+    // start the next frame just in time to be presented by its deadline,
+    // the doubled estimate covers frame time variation
+    const uint64_t budget = std::min(period, work * 2 + safety_margin);
+    const uint64_t wakeup = deadline - budget;
+    const uint64_t time = now();
+    if (wakeup > time) {
+        SDL_Delay((wakeup - time) / 1000);
+    }
+}
+
+void FramePacer::restart()
+{
+    // the frame after idle is started immediately
+    deadline = now();
+    restarted = true;
+}
+
+uint64_t FramePacer::now() const
+{
+    const uint64_t counter = SDL_GetPerformanceCounter();
+    return counter / frequency * 1000000 +
+        counter % frequency * 1000000 / frequency;
+}
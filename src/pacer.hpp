@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: MIT
+// Frame pacer.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <SDL2/SDL.h>
+
+#include <cstdint>
+
+/**
+ * Frame pacer: keeps animation in sync with the display refresh rate.
+ * With vsync the frame rate is limited by the renderer, otherwise the pacer
+ * sleeps until the deadline of the next frame. In both cases the next frame
+ * is started as late as the estimated frame time allows, so that input is
+ * sampled right before drawing.
+ */
+class FramePacer {
+public:
+    FramePacer();
+
+    /**
+     * Set frame period from the refresh rate of the window's display.
+     * @param window game window
+     * @param vsync true if the renderer waits for vertical sync on present
+     */
+    void initialize(SDL_Window* window, bool vsync);
+
+    /** Start frame, must be called before input handling. */
+    void begin();
+
+    /** Mark the scene as drawn, must be called before presenting it. */
+    void drawn();
+
+    /**
+     * Finish frame, must be called after the scene is presented.
+     * @return false if the frame missed its deadline
+     */
+    bool finish();
+
+    /** Wait for the next frame. */
+    void wait();
+
+    /** Restart pacing, must be called after idle. */
+    void restart();
+
+private:
+    /**
+     * Get time from performance counter.
+     * @return time in microseconds
+     */
+    uint64_t now() const;
+
+    uint64_t frequency; ///< Performance counter frequency
+    uint64_t period;    ///< Frame period in microseconds
+    uint64_t deadline;  ///< Deadline of the current frame in microseconds
+    uint64_t start;     ///< Start time of the current frame in microseconds
+    uint64_t work;      ///< Estimated frame time (without present) in us
+    bool vsync;         ///< Renderer syncs with display
+    bool restarted;     ///< Current frame is the first one after idle
+};
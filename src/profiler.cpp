@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: MIT
+// Frame time profiler.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "profiler.hpp"
+
+#include <SDL2/SDL.h>
+
+#include <algorithm>
+#include <cstring>
+
+/** Period of summary update in ms. */
+static constexpr uint64_t summary_period = 500;
+
+/** Names of stages. */
+static const char* stage_names[] = { "events", "update", "draw", "flush" };
+
+Profiler::Profiler()
+    : overlay(false)
+    , frequency(SDL_GetPerformanceFrequency())
+    , frame_start(0)
+    , frame(0)
+    , frames(0)
+    , period_start(0)
+    , missed(0)
+    , clicks(0)
+    , clicked(false)
+    , click_latency(0)
+    , audio_estimate(0)
+    , trace(nullptr)
+{
+    memset(started, 0, sizeof(started));
+    memset(elapsed, 0, sizeof(elapsed));
+    memset(&total, 0, sizeof(total));
+    memset(durations, 0, sizeof(durations));
+    memset(&calls, 0, sizeof(calls));
+    memset(&switches, 0, sizeof(switches));
+    memset(&latency, 0, sizeof(latency));
+}
+
+Profiler::~Profiler()
+{
+    if (trace) {
+        fclose(trace);
+    }
+}
+
+bool Profiler::open_trace(const char* path)
+{
+    trace = fopen(path, "w");
+    if (!trace) {
+        return false;
+    }
+    fprintf(trace, "frame,timestamp_ms,events_us,update_us,draw_us,flush_us,"
+                   "total_us,draw_calls,texture_switches,missed,"
+                   "input_latency_ms,audio_latency_est_us\n");
+    return true;
+}
+
+void Profiler::begin_frame()
+{
+    frame_start = now();
+    memset(elapsed, 0, sizeof(elapsed));
+    clicked = false;
+}
+
+void Profiler::end_frame(uint64_t timestamp, size_t draw_calls,
+                         size_t tex_switches, bool late)
+{
+    const uint64_t frame_time = now() - frame_start;
+
+    ++frame;
+    ++frames;
+    total.sum += frame_time;
+    total.max = std::max(total.max, frame_time);
+    for (size_t i = 0; i < stages; ++i) {
+        durations[i].sum += elapsed[i];
+        durations[i].max = std::max(durations[i].max, elapsed[i]);
+    }
+    calls.sum += draw_calls;
+    calls.max = std::max<uint64_t>(calls.max, draw_calls);
+    switches.sum += tex_switches;
+    switches.max = std::max<uint64_t>(switches.max, tex_switches);
+    if (late) {
+        ++missed;
+    }
+    if (clicked) {
+        ++clicks;
+        latency.sum += click_latency;
+        latency.max = std::max(latency.max, click_latency);
+    }
+
+    if (trace) {
+        fprintf(trace, "%zu,%llu,%llu,%llu,%llu,%llu,%llu,%zu,%zu,%d,", frame,
+                static_cast<unsigned long long>(timestamp),
+                static_cast<unsigned long long>(elapsed[Events]),
+                static_cast<unsigned long long>(elapsed[Update]),
+                static_cast<unsigned long long>(elapsed[Draw]),
+                static_cast<unsigned long long>(elapsed[Flush]),
+                static_cast<unsigned long long>(frame_time),
+                draw_calls, tex_switches, late ? 1 : 0);
+        if (clicked) {
+            fprintf(trace, "%llu",
+                    static_cast<unsigned long long>(click_latency));
+        }
+        fprintf(trace, ",%llu\n",
+                static_cast<unsigned long long>(audio_estimate));
+    }
+
+    if (timestamp - period_start >= summary_period || text.empty()) {
+        update_summary(timestamp);
+    }
+}
+
+void Profiler::input(uint64_t delay)
+{
+    clicked = true;
+    click_latency = delay;
+}
+
+void Profiler::start(Stage stage)
+{
+    started[stage] = now();
+}
+
+void Profiler::stop(Stage stage)
+{
+    elapsed[stage] += now() - started[stage];
+}
+
+uint64_t Profiler::now() const
+{
+    const uint64_t counter = SDL_GetPerformanceCounter();
+    return counter / frequency * 1000000 +
+        counter % frequency * 1000000 / frequency;
+}
+
+void Profiler::update_summary(uint64_t timestamp)
+{
+    char line[64];
+
+    text.clear();
+    if (frames) {
+        text += "          avg    max\n";
+        snprintf(line, sizeof(line), "frame  %6.2f %6.2f ms\n",
+                 static_cast<double>(total.sum) / frames / 1000,
+                 static_cast<double>(total.max) / 1000);
+        text += line;
+        for (size_t i = 0; i < stages; ++i) {
+            snprintf(line, sizeof(line), "%-6s %6.2f %6.2f ms\n",
+                     stage_names[i],
+                     static_cast<double>(durations[i].sum) / frames / 1000,
+                     static_cast<double>(durations[i].max) / 1000);
+            text += line;
+        }
+        snprintf(line, sizeof(line), "calls  %6.1f %6llu\n",
+                 static_cast<double>(calls.sum) / frames,
+                 static_cast<unsigned long long>(calls.max));
+        text += line;
+        snprintf(line, sizeof(line), "switch %6.1f %6llu\n",
+                 static_cast<double>(switches.sum) / frames,
+                 static_cast<unsigned long long>(switches.max));
+        text += line;
+        snprintf(line, sizeof(line), "missed %6zu\n", missed);
+        text += line;
+    }
+    if (clicks) {
+        snprintf(line, sizeof(line), "input  %6.1f %6llu ms\n",
+                 static_cast<double>(latency.sum) / clicks,
+                 static_cast<unsigned long long>(latency.max));
+        text += line;
+    }
+    if (audio_estimate) {
+        snprintf(line, sizeof(line), "audio~ %6.2f        ms\n",
+                 static_cast<double>(audio_estimate) / 1000);
+        text += line;
+    }
+
+    // start new period
+    period_start = timestamp;
+    frames = 0;
+    memset(&total, 0, sizeof(total));
+    memset(durations, 0, sizeof(durations));
+    memset(&calls, 0, sizeof(calls));
+    memset(&switches, 0, sizeof(switches));
+    missed = 0;
+    clicks = 0;
+    memset(&latency, 0, sizeof(latency));
+}
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: MIT
+// Frame time profiler.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/** Frame time profiler: measures stages of the main loop. */
+class Profiler {
+public:
+    /** Stages of the frame. */
+    enum Stage {
+        Events, ///< Event handling
+        Update, ///< Game state update
+        Draw,   ///< Scene drawing
+        Flush,  ///< Render flush (submit and present)
+    };
+
+    Profiler();
+    ~Profiler();
+
+    /**
+     * Open CSV trace file.
+     * @param path path to the file
+     * @return false if file can not be created
+     */
+    bool open_trace(const char* path);
+
+    /** Start new frame. */
+    void begin_frame();
+
+    /**
+     * Finish current frame: update statistics and write trace.
+     * @param timestamp frame timestamp in milliseconds
+     * @param draw_calls number of draw calls in the frame
+     * @param tex_switches number of texture switches in the frame
+     * @param late true if the frame missed its deadline
+     */
+    void end_frame(uint64_t timestamp, size_t draw_calls, size_t tex_switches,
+                   bool late);
+
+    /**
+     * Register input latency of the current frame.
+     * @param delay time from the click to the present in milliseconds
+     */
+    void input(uint64_t delay);
+
+    /**
+     * Register current estimate of audio output latency.
+     * @param delay latency estimate in microseconds, 0 if unknown
+     */
+    void audio(uint64_t delay) { audio_estimate = delay; }
+
+    /**
+     * Start measuring stage.
+     * @param stage frame stage
+     */
+    void start(Stage stage);
+
+    /**
+     * Stop measuring stage.
+     * @param stage frame stage
+     */
+    void stop(Stage stage);
+
+    /**
+     * Get summary text for the overlay, updated twice per second.
+     * @return multiline text
+     */
+    const std::string& summary() const { return text; }
+
+    bool overlay; ///< Overlay visibility
+
+private:
+    /** Number of stages. */
+    static constexpr size_t stages = Flush + 1;
+
+    /** Statistics of a single value. */
+    struct Value {
+        uint64_t sum; ///< Sum of all values
+        uint64_t max; ///< Max value
+    };
+
+    /**
+     * Get time from performance counter.
+     * @return time in microseconds
+     */
+    uint64_t now() const;
+
+    /**
+     * Rebuild summary text.
+     * @param timestamp current frame timestamp in milliseconds
+     */
+    void update_summary(uint64_t timestamp);
+
+    uint64_t frequency;       ///< Performance counter frequency
+    uint64_t frame_start;     ///< Start time of current frame in us
+    uint64_t started[stages]; ///< Start time of stages in us
+    uint64_t elapsed[stages]; ///< Duration of stages in current frame in us
+
+    size_t frame;            ///< Frame number
+    size_t frames;           ///< Number of frames in statistics
+    uint64_t period_start;   ///< Start of statistics period in ms
+    Value total;             ///< Statistics for whole frame time
+    Value durations[stages]; ///< Statistics for stages
+    Value calls;             ///< Statistics for draw calls
+    Value switches;          ///< Statistics for texture switches
+    size_t missed;           ///< Number of missed deadlines
+    Value latency;           ///< Statistics for click-to-photon latency
+    size_t clicks;           ///< Number of clicks in statistics
+    bool clicked;            ///< Current frame handles a click
+    uint64_t click_latency;  ///< Latency of the click in current frame, ms
+    uint64_t audio_estimate; ///< Audio output latency estimate in us
+    std::string text;        ///< Summary text
+
+    FILE* trace; ///< CSV trace file
+};
@@ -6,11 +6,16 @@
 
 #include <SDL2/SDL_image.h>
 
+#include <algorithm>
+#include <cmath>
 #include <cstring>
 #include <memory>
 
 using SdlSurface = std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>;
 
+/** Max memory used by the text cache in bytes. */
+static constexpr size_t text_cache_limit = 256 * 1024;
+
 /** Skin image splitter. */
 struct SkinImage {
     static constexpr char font_first_char = ' ';
@@ -71,33 +76,149 @@ struct SkinImage {
         return nullptr;
     }
 
-    /* Get subimage from skin. */
-    SDL_Surface* get(Render::TextureId id) const
+    /**
+     * Check if texture is a pipe or its shadow.
+     * @param id texture type
+     * @return true if texture has pre-rotated copies in the atlas
+     */
+    static bool is_pipe(Render::TextureId id)
+    {
+        return id >= Render::PipeHalfOff && id <= Render::PipeForkShadow;
+    }
+
+    /**
+     * Get vertical position of the pipes row in the atlas.
+     * @param turns number of clockwise turns by 90 degrees
+     * @param shadow true for the row of shadows
+     * @return position in px
+     */
+    int pipes_row(size_t turns, bool shadow) const
+    {
+        const int row = 2 * static_cast<int>(unit_size);
+        if (turns == 0) {
+            return shadow ? image->h : row;
+        }
+        // rows of rotated pipes and their shadows are placed under
+        // the shadows of the original pipes
+        return image->h + row + (static_cast<int>(turns) - 1) * row * 2 +
+            (shadow ? row : 0);
+    }
+
+    /**
+     * Create atlas surface: the skin image with black shadows of the pipes
+     * and pipes with shadows turned by 90, 180 and 270 degrees appended to
+     * the bottom.
+     */
+    SDL_Surface* atlas() const
     {
-        const SDL_Rect* rect = find(id);
-        if (!rect) {
+        const SDL_Rect pipes = { 0, 2 * static_cast<int>(unit_size), image->w,
+                                 2 * static_cast<int>(unit_size) };
+
+        SdlSurface atlas(SDL_CreateRGBSurface(0, image->w,
+                                              pipes_row(3, true) + pipes.h,
+                                              32, 0x000000ff, 0x0000ff00,
+                                              0x00ff0000, 0xff000000),
+                         &SDL_FreeSurface);
+        if (!atlas) {
             return nullptr;
         }
 
-        SDL_Rect src = *rect;
-        src.x *= unit_size;
-        src.y *= unit_size;
-        src.w *= unit_size;
-        src.h *= unit_size;
+        SDL_Rect dst = { 0, 0, image->w, image->h };
+        SDL_SetSurfaceBlendMode(image, SDL_BLENDMODE_NONE);
+        if (SDL_BlitSurface(image, nullptr, atlas.get(), &dst)) {
+            return nullptr;
+        }
+        dst = pipes;
+        dst.y = image->h;
+        if (SDL_BlitSurface(image, &pipes, atlas.get(), &dst)) {
+            return nullptr;
+        }
 
-        SDL_Rect dst;
-        dst.x = 0;
-        dst.y = 0;
-        dst.w = src.w;
-        dst.h = src.h;
+        // convert any color of the shadows to black
+        for (int y = dst.y; y < dst.y + dst.h; ++y) {
+            uint32_t* pixels = row_pixels(atlas.get(), y);
+            for (int x = 0; x < dst.w; ++x) {
+                if (pixels[x]) {
+                    pixels[x] = 0xff000000;
+                }
+            }
+        }
 
-        SdlSurface sub(SDL_CreateRGBSurface(0, dst.w, dst.h, 32, 0x000000ff,
-                                            0x0000ff00, 0x00ff0000, 0xff000000),
-                       &SDL_FreeSurface);
-        if (sub && SDL_BlitSurface(image, &src, sub.get(), &dst)) {
-            return nullptr;
+        // turn each square pipe sprite clockwise
+        const int size = pipes.h;
+        for (size_t turns = 1; turns < 4; ++turns) {
+            for (const bool shadow : { false, true }) {
+                const int src_y = pipes_row(0, shadow);
+                const int dst_y = pipes_row(turns, shadow);
+                for (int y = 0; y < size; ++y) {
+                    const uint32_t* src = row_pixels(atlas.get(), src_y + y);
+                    for (int x = 0; x < pipes.w; ++x) {
+                        const int sprite = x / size * size;
+                        const int sx = x - sprite;
+                        int tx, ty;
+                        switch (turns) {
+                            case 1:
+                                tx = size - 1 - y;
+                                ty = sx;
+                                break;
+                            case 2:
+                                tx = size - 1 - sx;
+                                ty = size - 1 - y;
+                                break;
+                            default:
+                                tx = y;
+                                ty = size - 1 - sx;
+                                break;
+                        }
+                        row_pixels(atlas.get(), dst_y + ty)[sprite + tx] =
+                            src[x];
+                    }
+                }
+            }
         }
-        return sub.release();
+
+        return atlas.release();
+    }
+
+    /**
+     * Get pixels of the surface row.
+     * @param surface 32-bit surface
+     * @param y row index
+     * @return pointer to the first pixel of the row
+     */
+    static uint32_t* row_pixels(SDL_Surface* surface, int y)
+    {
+        return reinterpret_cast<uint32_t*>(
+            reinterpret_cast<uint8_t*>(surface->pixels) + y * surface->pitch);
+    }
+
+    /**
+     * Get texture region inside the atlas.
+     * @param id texture type
+     * @param turns number of clockwise turns by 90 degrees (pipes only)
+     * @param rect output rectangle in px
+     * @return false if texture is not found
+     */
+    bool get(Render::TextureId id, size_t turns, SDL_Rect& rect) const
+    {
+        const bool is_shadow =
+            (id == Render::PipeHalfShadow || id == Render::PipeBentShadow ||
+             id == Render::PipeStrShadow || id == Render::PipeForkShadow);
+        const SDL_Rect* src = find(
+            static_cast<Render::TextureId>(id - (is_shadow ? 1 : 0)));
+        if (!src) {
+            return false;
+        }
+
+        rect.x = src->x * unit_size;
+        rect.y = src->y * unit_size;
+        rect.w = src->w * unit_size;
+        rect.h = src->h * unit_size;
+        if (is_pipe(id)) {
+            rect.y = pipes_row(turns, is_shadow);
+        }
+
+        return true;
     }
 
     SDL_Surface* image;
@@ -105,102 +226,374 @@ struct SkinImage {
 };
 
 Render::Render(SDL_Renderer* renderer)
-    : render(renderer)
+    : atlas(nullptr)
+    , render(renderer)
+    , layer(nullptr)
+    , layer_width(0)
+    , layer_height(0)
+    , clipping(false)
+    , text_bytes(0)
+    , software(false)
+    , sw_target(&sw_frame)
+    , sw_texture(nullptr)
 {
-    memset(&textures, 0, sizeof(textures));
+    memset(&stats, 0, sizeof(stats));
+    memset(&frame_stats, 0, sizeof(frame_stats));
+    last_texture = nullptr;
+
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(render, &info) == 0) {
+        software = (info.flags & SDL_RENDERER_SOFTWARE);
+    }
 }
 
-bool Render::load(SDL_Surface* image)
+bool Render::load(const std::string& name, SDL_Surface* image)
 {
     SkinImage splitter(image);
 
-    texunit_size = splitter.unit_size;
-
-    for (size_t i = 0; i < sizeof(textures) / sizeof(textures[0]); ++i) {
-        Texture& texture = textures[i];
-        const bool is_shadow = (i == PipeHalfShadow || i == PipeBentShadow ||
-                                i == PipeStrShadow || i == PipeForkShadow);
-
-        const TextureId id = static_cast<TextureId>(i - (is_shadow ? 1 : 0));
-        SdlSurface sub(splitter.get(id), &SDL_FreeSurface);
-        if (!sub) {
-            return false;
-        }
-
-        if (is_shadow) {
-            // convert any color to black
-            uint32_t* pixels = reinterpret_cast<uint32_t*>(sub->pixels);
-            for (int y = 0; y < sub->h; ++y) {
-                for (int x = 0; x < sub->w; ++x) {
-                    uint32_t& color = *(pixels + y * sub->w + x);
-                    if (color) {
-                        color = 0xff000000;
-                    }
-                }
+    SDL_Rect rects[TextureId::Font + 1][4];
+    for (size_t i = 0; i < sizeof(rects) / sizeof(rects[0]); ++i) {
+        for (size_t turns = 0; turns < 4; ++turns) {
+            if (!splitter.get(static_cast<TextureId>(i), turns,
+                              rects[i][turns])) {
+                return false;
             }
         }
+    }
 
-        // create texture from subimage
-        SDL_Texture* tx = SDL_CreateTextureFromSurface(render, sub.get());
+    SdlSurface surface(splitter.atlas(), &SDL_FreeSurface);
+    if (!surface) {
+        return false;
+    }
+    Canvas canvas;
+    SDL_Texture* tx = nullptr;
+    if (software) {
+        if (!canvas.load(surface.get())) {
+            return false;
+        }
+    } else {
+        tx = SDL_CreateTextureFromSurface(render, surface.get());
         if (!tx) {
             return false;
         }
-        // put texture into array
-        if (texture.texture) {
-            SDL_DestroyTexture(texture.texture);
+        SDL_SetTextureBlendMode(tx, SDL_BLENDMODE_BLEND);
+    }
+
+    Atlas& entry = atlases[name];
+    if (entry.texture) {
+        SDL_DestroyTexture(entry.texture);
+    }
+    entry.texture = tx;
+    entry.canvas = std::move(canvas);
+    entry.width = surface->w;
+    entry.height = surface->h;
+    entry.unit_size = splitter.unit_size;
+
+    atlas = &entry;
+    for (size_t i = 0; i < sizeof(rects) / sizeof(rects[0]); ++i) {
+        Texture& texture = entry.textures[i];
+        texture.turnable = SkinImage::is_pipe(static_cast<TextureId>(i));
+        for (size_t turns = 0; turns < 4; ++turns) {
+            texture.rect[turns] = rects[i][turns];
+            tex_coords(texture.rect[turns], texture.uv[turns]);
         }
-        texture.texture = tx;
-        texture.rect.w = sub->w;
-        texture.rect.h = sub->h;
     }
 
+    // cached text refers to the old atlas
+    text_runs.clear();
+    text_index.clear();
+    text_bytes = 0;
+
+    return true;
+}
+
+bool Render::select(const std::string& name)
+{
+    const auto it = atlases.find(name);
+    if (it == atlases.end()) {
+        return false;
+    }
+    if (atlas != &it->second) {
+        atlas = &it->second;
+        text_runs.clear();
+        text_index.clear();
+        text_bytes = 0;
+    }
     return true;
 }
 
 void Render::clear()
 {
+    vertices.clear();
+    indices.clear();
+
+    if (software) {
+        // the scene is drawn in window coordinates, as well as the cached
+        // layer, the frame is scaled to the output by the renderer
+        int width = 0, height = 0;
+        SDL_GetWindowSize(SDL_RenderGetWindow(render), &width, &height);
+        if (!sw_texture || sw_frame.width != width ||
+            sw_frame.height != height) {
+            if (sw_texture) {
+                SDL_DestroyTexture(sw_texture);
+            }
+            sw_texture =
+                SDL_CreateTexture(render, SDL_PIXELFORMAT_ARGB8888,
+                                  SDL_TEXTUREACCESS_STREAMING, width, height);
+            sw_frame.resize(width, height);
+        }
+        sw_frame.fill(0xff000000);
+        sw_target = &sw_frame;
+    }
+
     SDL_RenderClear(render);
 }
 
 void Render::flush()
 {
+    if (software) {
+        if (sw_texture) {
+            SDL_UpdateTexture(sw_texture, nullptr, sw_frame.pixels.data(),
+                              sw_frame.width * sizeof(uint32_t));
+            count(sw_texture);
+            SDL_RenderCopy(render, sw_texture, nullptr, nullptr);
+        }
+    } else {
+        submit();
+    }
     SDL_RenderPresent(render);
+
+    stats = frame_stats;
+    memset(&frame_stats, 0, sizeof(frame_stats));
+    last_texture = nullptr;
+}
+
+void Render::submit()
+{
+    if (!indices.empty()) {
+        count(atlas->texture);
+        SDL_RenderGeometry(render, atlas->texture, vertices.data(),
+                           vertices.size(), indices.data(), indices.size());
+        vertices.clear();
+        indices.clear();
+    }
+}
+
+bool Render::prepare_layer(int width, int height)
+{
+    if (software) {
+        if (sw_layer.width != width || sw_layer.height != height) {
+            sw_layer.resize(width, height);
+        }
+        return true;
+    }
+
+    if (layer && layer_width == width && layer_height == height) {
+        return true;
+    }
+
+    if (layer) {
+        SDL_DestroyTexture(layer);
+        layer = nullptr;
+    }
+    if (!SDL_RenderTargetSupported(render)) {
+        return false;
+    }
+    layer = SDL_CreateTexture(render, SDL_PIXELFORMAT_ARGB8888,
+                              SDL_TEXTUREACCESS_TARGET, width, height);
+    if (!layer) {
+        return false;
+    }
+    SDL_SetTextureBlendMode(layer, SDL_BLENDMODE_NONE);
+    layer_width = width;
+    layer_height = height;
+
+    return true;
+}
+
+void Render::begin_layer(const SDL_Rect* area)
+{
+    if (software) {
+        sw_target = &sw_layer;
+    } else {
+        submit();
+        SDL_SetRenderTarget(render, layer);
+    }
+    if (area) {
+        set_clip(area);
+    }
+}
+
+void Render::end_layer()
+{
+    set_clip(nullptr);
+    if (software) {
+        sw_target = &sw_frame;
+    } else {
+        submit();
+        SDL_SetRenderTarget(render, nullptr);
+    }
+}
+
+void Render::draw_layer()
+{
+    if (software) {
+        // sizes differ only until the window resize event is handled: the
+        // common area is copied, the event rebuilds the layer in a new size
+        sw_frame.copy(sw_layer);
+    } else {
+        submit();
+        count(layer);
+        SDL_RenderCopy(render, layer, nullptr, nullptr);
+    }
+}
+
+void Render::set_clip(const SDL_Rect* area)
+{
+    if (!area && !clipping) {
+        return;
+    }
+    if (!software) {
+        submit(); // queued quads belong to the previous area
+        SDL_RenderSetClipRect(render, area);
+    }
+    clipping = area;
+    if (area) {
+        clip = *area;
+    }
 }
 
 void Render::fill_background(int width, int height)
 {
-    Texture& tex = textures[WindowBkg];
+    const SDL_Color color = { 0xff, 0xff, 0xff, 0xff };
+    const Texture& tex = atlas->textures[WindowBkg];
+
+    // range of tiles to draw
+    int first_x = 0, first_y = 0;
+    int last_x = width, last_y = height;
+    if (clipping) {
+        first_x = std::max(0, clip.x) / tex.rect[0].w * tex.rect[0].w;
+        first_y = std::max(0, clip.y) / tex.rect[0].h * tex.rect[0].h;
+        last_x = std::min(width, clip.x + clip.w);
+        last_y = std::min(height, clip.y + clip.h);
+    }
+
     SDL_Rect dst;
-    dst.w = tex.rect.w;
-    dst.h = tex.rect.h;
-    for (dst.y = 0; dst.y < height; dst.y += dst.h) {
-        for (dst.x = 0; dst.x < width; dst.x += dst.w) {
-            SDL_RenderCopy(render, tex.texture, &tex.rect, &dst);
+    dst.w = tex.rect[0].w;
+    dst.h = tex.rect[0].h;
+    for (dst.y = first_y; dst.y < last_y; dst.y += dst.h) {
+        for (dst.x = first_x; dst.x < last_x; dst.x += dst.w) {
+            put(tex.rect[0], tex.uv[0], dst, 0, color);
         }
     }
 }
 
 void Render::draw(TextureId id, SDL_Rect& dst, double angle, double alpha)
 {
-    Texture& tex = textures[id];
-    SDL_SetTextureAlphaMod(tex.texture, alpha * 0xff);
-    SDL_RenderCopyEx(render, tex.texture, &tex.rect, &dst, angle, nullptr,
-                     SDL_FLIP_NONE);
+    const bool is_shadow = (id == PipeHalfShadow || id == PipeBentShadow ||
+                            id == PipeStrShadow || id == PipeForkShadow);
+    const uint8_t rgb = is_shadow ? 0 : 0xff;
+    const SDL_Color color = { rgb, rgb, rgb,
+                              static_cast<uint8_t>(alpha * 0xff) };
+    const Texture& tex = atlas->textures[id];
+
+    // static pipes are drawn from pre-rotated sprites without rotation,
+    // arbitrary angles are used only while the pipe is rotating
+    const int turns = static_cast<int>(angle) / 90;
+    if (tex.turnable && turns * 90 == angle && turns >= 0 && turns < 4) {
+        put(tex.rect[turns], tex.uv[turns], dst, 0, color);
+    } else {
+        put(tex.rect[0], tex.uv[0], dst, angle, color);
+    }
 }
 
 void Render::draw_text(const char* text, size_t size, int x, int y)
 {
-    Texture& font = textures[Font];
+    const TextRun& run = text_run(text, size);
+
+    if (software) {
+        const SDL_Color color = { 0xff, 0xff, 0xff, 0xff };
+        for (const Glyph& glyph : run.glyphs) {
+            SDL_Rect dst = glyph.dst;
+            dst.x += x;
+            dst.y += y;
+            put(glyph.src, nullptr, dst, 0, color);
+        }
+        return;
+    }
+
+    if (clipping &&
+        (x + run.box.w <= clip.x || x >= clip.x + clip.w ||
+         y + run.box.h <= clip.y || y >= clip.y + clip.h)) {
+        return; // out of updated area
+    }
 
-    SDL_Rect src;
-    src.w = texunit_size;
-    src.h = texunit_size;
+    const int base = vertices.size();
+    for (SDL_Vertex vertex : run.vertices) {
+        vertex.position.x += x;
+        vertex.position.y += y;
+        vertices.push_back(vertex);
+    }
+    const int quad[] = { 0, 1, 2, 0, 2, 3 };
+    for (size_t i = 0; i < run.vertices.size(); i += 4) {
+        for (const int index : quad) {
+            indices.push_back(base + i + index);
+        }
+    }
+}
 
-    SDL_Rect dst;
-    dst.x = x;
-    dst.y = y;
-    dst.w = size;
-    dst.h = size;
+size_t Render::text_width(const char* text, size_t size)
+{
+    return text_run(text, size).width;
+}
+
+bool Render::TextKey::operator==(const TextKey& other) const
+{
+    return length == other.length && size == other.size &&
+        memcmp(text, other.text, length) == 0;
+}
+
+size_t Render::TextKeyHash::operator()(const TextKey& key) const
+{
+    // FNV-1a
+    uint32_t hash = 0x811c9dc5;
+    for (size_t i = 0; i < key.length; ++i) {
+        hash ^= static_cast<uint8_t>(key.text[i]);
+        hash *= 0x01000193;
+    }
+    return hash ^ key.size;
+}
+
+const Render::TextRun& Render::text_run(const char* text, size_t size)
+{
+    const TextKey key = { text, strlen(text), size };
+    const auto it = text_index.find(key);
+    if (it != text_index.end()) {
+        // move to the front of the LRU list
+        text_runs.splice(text_runs.begin(), text_runs, it->second);
+        return *it->second;
+    }
+
+    text_runs.emplace_front();
+    TextRun& run = text_runs.front();
+    run.text.assign(text, key.length);
+    run.size = size;
+    run.width = 0;
+    run.box.x = 0;
+    run.box.y = 0;
+    run.box.w = 0;
+    run.box.h = size;
+
+    const SDL_Color color = { 0xff, 0xff, 0xff, 0xff };
+    const SDL_Rect& font = atlas->textures[Font].rect[0];
+
+    Glyph glyph;
+    glyph.src.w = atlas->unit_size;
+    glyph.src.h = atlas->unit_size;
+    glyph.dst.x = 0;
+    glyph.dst.y = 0;
+    glyph.dst.w = size;
+    glyph.dst.h = size;
 
     while (*text) {
         if (*text < SkinImage::font_first_char ||
@@ -213,27 +606,136 @@ void Render::draw_text(const char* text, size_t size, int x, int y)
         const size_t index = *text - SkinImage::font_first_char;
         const size_t row = index % SkinImage::tex_per_image;
         const size_t col = index / SkinImage::tex_per_image;
-        src.x = row * texunit_size;
-        src.y = col * texunit_size;
-
-        SDL_RenderCopy(render, font.texture, &src, &dst);
+        glyph.src.x = font.x + row * atlas->unit_size;
+        glyph.src.y = font.y + col * atlas->unit_size;
+
+        if (software) {
+            run.glyphs.push_back(glyph);
+        } else {
+            SDL_FPoint uv[4];
+            tex_coords(glyph.src, uv);
+            const float left = glyph.dst.x;
+            const float right = left + glyph.dst.w;
+            const float bottom = glyph.dst.h;
+            const SDL_FPoint corners[] = {
+                { left, 0 }, { right, 0 }, { right, bottom }, { left, bottom }
+            };
+            for (size_t i = 0; i < 4; ++i) {
+                run.vertices.push_back({ corners[i], color, uv[i] });
+            }
+        }
+        run.box.w = glyph.dst.x + glyph.dst.w;
 
-        dst.x += static_cast<float>(size) * 0.6;
+        glyph.dst.x += static_cast<float>(size) * 0.6;
+        run.width += static_cast<float>(size) * 0.6;
         ++text;
     }
+
+    run.bytes = sizeof(run) + run.text.capacity() +
+        run.glyphs.capacity() * sizeof(Glyph) +
+        run.vertices.capacity() * sizeof(SDL_Vertex);
+    text_bytes += run.bytes;
+    // the key refers to the text owned by the run
+    const TextKey own_key = { run.text.data(), run.text.size(), size };
+    text_index[own_key] = text_runs.begin();
+
+    // evict least recently used runs, but keep the new one
+    while (text_bytes > text_cache_limit && text_runs.size() > 1) {
+        const TextRun& last = text_runs.back();
+        const TextKey last_key = { last.text.data(), last.text.size(),
+                                   last.size };
+        text_bytes -= last.bytes;
+        text_index.erase(last_key);
+        text_runs.pop_back();
+    }
+
+    return run;
 }
 
-size_t Render::text_width(const char* text, size_t size)
+void Render::tex_coords(const SDL_Rect& src, SDL_FPoint* uv) const
 {
-    size_t width = 0;
+    // shift texture coordinates to the texel centers to prevent bleeding of
+    // the neighbor atlas regions with linear filtering
+    const float left = (src.x + 0.5f) / atlas->width;
+    const float right = (src.x + src.w - 0.5f) / atlas->width;
+    const float top = (src.y + 0.5f) / atlas->height;
+    const float bottom = (src.y + src.h - 0.5f) / atlas->height;
+    uv[0] = { left, top };
+    uv[1] = { right, top };
+    uv[2] = { right, bottom };
+    uv[3] = { left, bottom };
+}
 
-    while (*text) {
-        if (*text >= SkinImage::font_first_char &&
-            *text <= SkinImage::font_last_char) {
-            width += static_cast<float>(size) * 0.6;
-        }
-        ++text;
+void Render::push(const SDL_FPoint* uv, const SDL_Rect& dst, double angle,
+                  const SDL_Color& color)
+{
+    // quad corners: top-left, top-right, bottom-right, bottom-left
+    static const float corner_x[] = { -1, 1, 1, -1 };
+    static const float corner_y[] = { -1, -1, 1, 1 };
+
+    const float half_w = static_cast<float>(dst.w) / 2;
+    const float half_h = static_cast<float>(dst.h) / 2;
+    const float center_x = dst.x + half_w;
+    const float center_y = dst.y + half_h;
+
+    float cos_a = 1, sin_a = 0;
+    if (angle) {
+        const double rad = angle * M_PI / 180;
+        cos_a = cos(rad);
+        sin_a = sin(rad);
+    }
+
+    SDL_Vertex quad_vertices[4];
+    float min_x = center_x, max_x = center_x;
+    float min_y = center_y, max_y = center_y;
+    for (size_t i = 0; i < 4; ++i) {
+        const float x = corner_x[i] * half_w;
+        const float y = corner_y[i] * half_h;
+        SDL_Vertex& vertex = quad_vertices[i];
+        vertex.position.x = center_x + x * cos_a - y * sin_a;
+        vertex.position.y = center_y + x * sin_a + y * cos_a;
+        vertex.color = color;
+        vertex.tex_coord = uv[i];
+        min_x = std::min(min_x, vertex.position.x);
+        max_x = std::max(max_x, vertex.position.x);
+        min_y = std::min(min_y, vertex.position.y);
+        max_y = std::max(max_y, vertex.position.y);
+    }
+
+    if (clipping &&
+        (max_x <= clip.x || min_x >= clip.x + clip.w || max_y <= clip.y ||
+         min_y >= clip.y + clip.h)) {
+        return; // out of updated area
+    }
+
+    const int base = vertices.size();
+    vertices.insert(vertices.end(), quad_vertices, quad_vertices + 4);
+
+    const int quad[] = { 0, 1, 2, 0, 2, 3 };
+    for (const int index : quad) {
+        indices.push_back(base + index);
     }
+}
 
-    return width;
+void Render::put(const SDL_Rect& src, const SDL_FPoint* uv,
+                 const SDL_Rect& dst, double angle, const SDL_Color& color)
+{
+    if (software) {
+        const uint32_t argb = (static_cast<uint32_t>(color.a) << 24) |
+            (static_cast<uint32_t>(color.r) << 16) |
+            (static_cast<uint32_t>(color.g) << 8) | color.b;
+        sw_target->draw(atlas->canvas, src, dst, angle, argb,
+                        clipping ? &clip : nullptr);
+    } else {
+        push(uv, dst, angle, color);
+    }
+}
+
+void Render::count(SDL_Texture* texture)
+{
+    ++frame_stats.draw_calls;
+    if (texture != last_texture) {
+        ++frame_stats.texture_switches;
+        last_texture = texture;
+    }
 }
@@ -6,7 +6,13 @@
 
 #include <SDL2/SDL.h>
 
+#include <list>
+#include <map>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "canvas.hpp"
 
 /** UI renderer. */
 class Render {
@@ -49,16 +55,26 @@ public:
 
     /**
      * Constructor.
+     * Uses CPU compositor if the renderer is not accelerated.
      * @param renderer SDL renderer instance
      */
     Render(SDL_Renderer* renderer);
 
     /**
-     * Load textures from image (skin).
+     * Load textures from image (skin) and make them current.
+     * Loaded skins are kept in memory, see select().
+     * @param name skin name
      * @param image image to load
      * @return false if something went wrong
      */
-    bool load(SDL_Surface* image);
+    bool load(const std::string& name, SDL_Surface* image);
+
+    /**
+     * Switch to previously loaded skin.
+     * @param name skin name
+     * @return false if the skin was not loaded yet
+     */
+    bool select(const std::string& name);
 
     /** Clear render queue, must be called before drawing scene. */
     void clear();
@@ -66,7 +82,41 @@ public:
     void flush();
 
     /**
-     * Fill window background.
+     * Submit queued geometry to the renderer.
+     * All textures live in the same atlas, so the whole queue is drawn with
+     * a single call.
+     */
+    void submit();
+
+    /**
+     * Prepare cached layer, (re)create it if the size was changed.
+     * @param width,height size of the layer in px
+     * @return false if render targets are not supported
+     */
+    bool prepare_layer(int width, int height);
+
+    /**
+     * Redirect drawing to the cached layer.
+     * Quads outside the area are dropped from the queue.
+     * @param area region of the layer to update, nullptr for whole layer
+     */
+    void begin_layer(const SDL_Rect* area);
+
+    /** Stop drawing to the cached layer. */
+    void end_layer();
+
+    /** Draw cached layer to the window. */
+    void draw_layer();
+
+    /**
+     * Limit drawing to the area of the current target.
+     * Quads outside the area are dropped from the queue.
+     * @param area region to update, nullptr to disable clipping
+     */
+    void set_clip(const SDL_Rect* area);
+
+    /**
+     * Fill window background, only tiles inside the clip area are drawn.
      * @param width,height size of the window
      */
     void fill_background(int width, int height);
@@ -82,6 +132,8 @@ public:
 
     /**
      * Draw text.
+     * Glyph runs are cached, so drawing the same string again only copies
+     * the prepared quads.
      * @param text text to draw
      * @param size font size in px
      * @param x,y top-left coordinates
@@ -96,14 +148,133 @@ public:
      */
     size_t text_width(const char* text, size_t size);
 
+    /** Render statistics. */
+    struct Stats {
+        size_t draw_calls;       ///< Number of draw calls
+        size_t texture_switches; ///< Number of texture switches
+    };
+    Stats stats; ///< Statistics of the last presented frame
+
 private:
+    /** Glyph of the text run. */
+    struct Glyph {
+        SDL_Rect src; ///< Region in the atlas
+        SDL_Rect dst; ///< Position relative to the text origin
+    };
+
+    /** Cached text run: prepared glyphs of the string. */
+    struct TextRun {
+        std::string text;                 ///< Source text
+        size_t size;                      ///< Font size in px
+        size_t width;                     ///< Text width in px
+        SDL_Rect box;                     ///< Area covered by the glyphs
+        std::vector<Glyph> glyphs;        ///< Glyphs (software renderer)
+        std::vector<SDL_Vertex> vertices; ///< Glyph quads (GPU renderer)
+        size_t bytes;                     ///< Memory used by the run
+    };
+
+    /**
+     * Key of the text run cache, refers to the text without copying it:
+     * lookup doesn't allocate memory.
+     */
+    struct TextKey {
+        const char* text; ///< Source text
+        size_t length;    ///< Text length
+        size_t size;      ///< Font size in px
+
+        bool operator==(const TextKey& other) const;
+    };
+
+    /** Hash function of the text run key. */
+    struct TextKeyHash {
+        size_t operator()(const TextKey& key) const;
+    };
+
     /** Texture description. */
     struct Texture {
-        SDL_Rect rect;
-        SDL_Texture* texture;
+        SDL_Rect rect[4];    ///< Regions for each orientation (0-270 deg)
+        SDL_FPoint uv[4][4]; ///< Corners of the regions
+        bool turnable;       ///< Regions contain pre-rotated sprites
+    };
+
+    /** Texture atlas: skin image with derived shadows. */
+    struct Atlas {
+        SDL_Texture* texture;                  ///< Atlas texture
+        Canvas canvas;                         ///< Atlas image (software)
+        int width;                             ///< Atlas width in px
+        int height;                            ///< Atlas height in px
+        size_t unit_size;                      ///< Size of texture unit in px
+        Texture textures[TextureId::Font + 1]; ///< Textures in atlas
     };
 
-    Texture textures[TextureId::Font + 1];
-    size_t texunit_size;
-    SDL_Renderer* render;
+    /**
+     * Get texture coordinates of the quad corners.
+     * @param src source rectangle inside the atlas
+     * @param uv output array of 4 corners (clockwise from top-left)
+     */
+    void tex_coords(const SDL_Rect& src, SDL_FPoint* uv) const;
+
+    /**
+     * Put textured quad to the render queue.
+     * @param uv texture coordinates of the quad corners
+     * @param dst position and size
+     * @param angle rotation angle in degrees (clockwise)
+     * @param color color and transparency modulation
+     */
+    void push(const SDL_FPoint* uv, const SDL_Rect& dst, double angle,
+              const SDL_Color& color);
+
+    /**
+     * Draw textured quad with current backend.
+     * @param src source rectangle inside the atlas
+     * @param uv texture coordinates of the quad corners
+     * @param dst position and size
+     * @param angle rotation angle in degrees (clockwise)
+     * @param color color and transparency modulation
+     */
+    void put(const SDL_Rect& src, const SDL_FPoint* uv, const SDL_Rect& dst,
+             double angle, const SDL_Color& color);
+
+    /**
+     * Get text run from cache, create it if not found.
+     * @param text source text
+     * @param size font size in px
+     * @return text run
+     */
+    const TextRun& text_run(const char* text, size_t size);
+
+    /**
+     * Update statistics before the draw call.
+     * @param texture texture used by the draw call
+     */
+    void count(SDL_Texture* texture);
+
+    std::map<std::string, Atlas> atlases; ///< Loaded skins
+    const Atlas* atlas;                   ///< Current atlas
+    SDL_Renderer* render;                 ///< SDL renderer instance
+
+    SDL_Texture* layer; ///< Cached layer (render target)
+    int layer_width;    ///< Cached layer width in px
+    int layer_height;   ///< Cached layer height in px
+    SDL_Rect clip;      ///< Currently updated area of the layer
+    bool clipping;      ///< Clip flag: drop quads outside the area
+
+    std::vector<SDL_Vertex> vertices; ///< Queued vertices
+    std::vector<int> indices;         ///< Queued triangles
+
+    std::list<TextRun> text_runs; ///< Text runs, most recently used first
+    std::unordered_map<TextKey, std::list<TextRun>::iterator, TextKeyHash>
+        text_index;    ///< Text runs by key, keys refer to the runs text
+    size_t text_bytes; ///< Memory used by the text runs
+
+    Stats frame_stats;         ///< Statistics of the current frame
+    SDL_Texture* last_texture; ///< Texture used by the last draw call
+
+    // software renderer: the scene is composited by CPU and uploaded
+    // to the streaming texture
+    bool software;           ///< Software rendering mode
+    Canvas sw_frame;         ///< Frame buffer
+    Canvas sw_layer;         ///< Cached layer
+    Canvas* sw_target;       ///< Current drawing target
+    SDL_Texture* sw_texture; ///< Streaming texture for the frame buffer
 };
@@ -9,11 +9,41 @@
 #include <SDL2/SDL_image.h>
 #include <dirent.h>
 
+#include <algorithm>
 #include <cstring>
 
-SDL_Surface* Skin::initialize(const std::string& name)
+/** Max size of decoded images in the preload cache. */
+static constexpr size_t cache_limit = 16 * 1024 * 1024;
+
+Skin::Skin()
+    : current(0)
+    , preloader(nullptr)
+    , lock(SDL_CreateMutex())
+    , cond(SDL_CreateCond())
+    , stop(false)
+    , cache_size(0)
+{
+}
+
+Skin::~Skin()
+{
+    if (preloader) {
+        SDL_LockMutex(lock);
+        stop = true;
+        SDL_CondBroadcast(cond);
+        SDL_UnlockMutex(lock);
+        SDL_WaitThread(preloader, nullptr);
+    }
+    for (auto& it : cache) {
+        SDL_FreeSurface(it.second);
+    }
+    SDL_DestroyCond(cond);
+    SDL_DestroyMutex(lock);
+}
+
+bool Skin::initialize(const std::string& name, const Loader& loader)
 {
-    SDL_Surface* image = nullptr;
+    bool loaded = false;
 
     search(APP_DATADIR);
 
@@ -27,61 +57,164 @@ SDL_Surface* Skin::initialize(const std::string& name)
             SDL_free(app_dir);
         }
     }
+    used.resize(available.size());
 
     // search for specified skin
     for (size_t i = 0; i < available.size(); ++i) {
         const std::string& path = available[i];
         if (name == get_name(path)) {
-            image = load(i);
+            loaded = load(i, loader);
             break;
         }
     }
     // fallback: load first available
-    for (size_t i = 0; !image && i < available.size(); ++i) {
-        image = load(i);
+    for (size_t i = 0; !loaded && i < available.size(); ++i) {
+        loaded = load(i, loader);
     }
 
-    return image;
+    return loaded;
 }
 
-SDL_Surface* Skin::prev()
+bool Skin::prev(const Loader& loader)
 {
-    SDL_Surface* image = nullptr;
+    bool loaded = false;
 
-    for (ssize_t i = current - 1; !image && i >= 0; --i) {
-        image = load(i);
+    for (ssize_t i = current - 1; !loaded && i >= 0; --i) {
+        loaded = load(i, loader);
     }
     for (ssize_t i = available.size() - 1;
-         !image && i > static_cast<ssize_t>(current); --i) {
-        image = load(i);
+         !loaded && i > static_cast<ssize_t>(current); --i) {
+        loaded = load(i, loader);
     }
 
-    return image;
+    return loaded;
 }
 
-SDL_Surface* Skin::next()
+bool Skin::next(const Loader& loader)
 {
-    SDL_Surface* image = nullptr;
+    bool loaded = false;
 
-    for (size_t i = current + 1; !image && i < available.size(); ++i) {
-        image = load(i);
+    for (size_t i = current + 1; !loaded && i < available.size(); ++i) {
+        loaded = load(i, loader);
     }
-    for (size_t i = 0; !image && i < current; ++i) {
-        image = load(i);
+    for (size_t i = 0; !loaded && i < current; ++i) {
+        loaded = load(i, loader);
     }
 
-    return image;
+    return loaded;
 }
 
-SDL_Surface* Skin::load(size_t index)
+bool Skin::load(size_t index, const Loader& loader)
 {
     const std::string& path = available[index];
-    SDL_Surface* image = IMG_Load(path.c_str());
-    if (image) {
-        name = get_name(path);
-        current = index;
+    const std::string skin_name = get_name(path);
+    if (!loader(skin_name, path)) {
+        return false;
+    }
+    name = skin_name;
+    current = index;
+    used[index] = true;
+    preload_neighbors();
+    return true;
+}
+
+SDL_Surface* Skin::image(const std::string& path)
+{
+    SDL_Surface* surface = nullptr;
+
+    SDL_LockMutex(lock);
+    queue.erase(std::remove(queue.begin(), queue.end(), path), queue.end());
+    while (decoding == path) {
+        SDL_CondWait(cond, lock); // already in progress
+    }
+    for (auto it = cache.begin(); it != cache.end(); ++it) {
+        if (it->first == path) {
+            surface = it->second;
+            cache_size -= surface->pitch * surface->h;
+            cache.erase(it);
+            break;
+        }
     }
-    return image;
+    SDL_UnlockMutex(lock);
+
+    if (!surface) {
+        surface = IMG_Load(path.c_str());
+    }
+
+    return surface;
+}
+
+void Skin::preload_neighbors()
+{
+    const size_t total = available.size();
+    const size_t neighbors[] = { (current + 1) % total,
+                                 (current + total - 1) % total };
+
+    SDL_LockMutex(lock);
+    queue.clear();
+    for (const size_t index : neighbors) {
+        // loaded skins are kept by the renderer, no need to decode them
+        if (!used[index] &&
+            std::find(queue.begin(), queue.end(), available[index]) ==
+                queue.end()) {
+            queue.push_back(available[index]);
+        }
+    }
+    if (!queue.empty()) {
+        if (!preloader) {
+            preloader = SDL_CreateThread(&Skin::preload, "skin", this);
+        }
+        SDL_CondBroadcast(cond);
+    }
+    SDL_UnlockMutex(lock);
+}
+
+int Skin::preload(void* data)
+{
+    Skin* skin = static_cast<Skin*>(data);
+
+    SDL_LockMutex(skin->lock);
+    while (!skin->stop) {
+        if (skin->queue.empty()) {
+            SDL_CondWait(skin->cond, skin->lock);
+            continue;
+        }
+        skin->decoding = skin->queue.front();
+        skin->queue.pop_front();
+
+        bool cached = false;
+        for (const auto& it : skin->cache) {
+            cached |= (it.first == skin->decoding);
+        }
+        if (!cached) {
+            SDL_UnlockMutex(skin->lock);
+            SDL_Surface* surface = IMG_Load(skin->decoding.c_str());
+            SDL_LockMutex(skin->lock);
+            if (surface) {
+                const size_t size = surface->pitch * surface->h;
+                // drop the oldest images to fit the cache size
+                while (!skin->cache.empty() &&
+                       skin->cache_size + size > cache_limit) {
+                    SDL_Surface* old = skin->cache.front().second;
+                    skin->cache_size -= old->pitch * old->h;
+                    SDL_FreeSurface(old);
+                    skin->cache.pop_front();
+                }
+                if (size <= cache_limit) {
+                    skin->cache.emplace_back(skin->decoding, surface);
+                    skin->cache_size += size;
+                } else {
+                    SDL_FreeSurface(surface);
+                }
+            }
+        }
+
+        skin->decoding.clear();
+        SDL_CondBroadcast(skin->cond);
+    }
+    SDL_UnlockMutex(skin->lock);
+
+    return 0;
 }
 
 void Skin::search(const char* path)
@@ -6,30 +6,60 @@
 
 #include <SDL2/SDL.h>
 
+#include <deque>
+#include <functional>
+#include <list>
 #include <string>
+#include <utility>
 #include <vector>
 
-/** Skin loader. */
+/**
+ * Skin loader.
+ * Neighbors of the current skin are decoded in background, so switching
+ * to them doesn't block on the image decoding.
+ */
 class Skin {
 public:
+    /**
+     * Skin loader callback.
+     * @param name skin name
+     * @param path path to the skin file
+     * @return false if skin can not be loaded
+     */
+    using Loader =
+        std::function<bool(const std::string& name, const std::string& path)>;
+
+    Skin();
+    ~Skin();
+
     /**
      * Initialization.
      * @param name name of the skin loaded by default
-     * @return image handle, nullptr on error
+     * @param loader skin loader
+     * @return false if no one skin was loaded
      */
-    SDL_Surface* initialize(const std::string& name);
+    bool initialize(const std::string& name, const Loader& loader);
 
     /**
      * Load previous available skin.
-     * @return image handle, nullptr on error
+     * @param loader skin loader
+     * @return false if no one skin was loaded
      */
-    SDL_Surface* prev();
+    bool prev(const Loader& loader);
 
     /**
      * Load next available skin.
-     * @return image handle, nullptr on error
+     * @param loader skin loader
+     * @return false if no one skin was loaded
      */
-    SDL_Surface* next();
+    bool next(const Loader& loader);
+
+    /**
+     * Get skin image: take it from the preload cache or decode the file.
+     * @param path path to the skin file
+     * @return image handle (must be freed by caller), nullptr on error
+     */
+    SDL_Surface* image(const std::string& path);
 
     std::string name; ///< Skin name
 
@@ -43,9 +73,10 @@ private:
     /**
      * Load skin.
      * @param index index of the skin record
-     * @return image handle, nullptr on error
+     * @param loader skin loader
+     * @return false if skin can not be loaded
      */
-    SDL_Surface* load(size_t index);
+    bool load(size_t index, const Loader& loader);
 
     /**
      * Get skin name from file path.
@@ -54,6 +85,30 @@ private:
      */
     std::string get_name(const std::string& path) const;
 
+    /** Queue neighbors of the current skin for background decoding. */
+    void preload_neighbors();
+
+    /**
+     * Preload thread entry point.
+     * @param data pointer to the skin instance
+     * @return thread exit code
+     */
+    static int preload(void* data);
+
     std::vector<std::string> available; ///< List of available skins
+    std::vector<bool> used;             ///< Skins accepted by the loader
     size_t current;                     ///< Index of the current skin
+
+    /** Decoded image: path to the file and its content. */
+    using Image = std::pair<std::string, SDL_Surface*>;
+
+    // background decoding, fields below are guarded by the lock
+    SDL_Thread* preloader;         ///< Preload thread
+    SDL_mutex* lock;               ///< Guard for the preload state
+    SDL_cond* cond;                ///< Preload state change
+    bool stop;                     ///< Preload thread must exit
+    std::deque<std::string> queue; ///< Paths to decode
+    std::string decoding;          ///< Path being decoded now
+    std::list<Image> cache;        ///< Decoded images, oldest first
+    size_t cache_size;             ///< Size of decoded images in bytes
 };
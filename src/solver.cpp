@@ -0,0 +1,385 @@
+// SPDX-License-Identifier: MIT
+// Level solver.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include "solver.hpp"
+
+#include <utility>
+
+/** Index of non-existent neighbor. */
+static constexpr size_t none = static_cast<size_t>(-1);
+
+/**
+ * Get opposite side.
+ * @param side side index
+ * @return index of the opposite side
+ */
+static inline size_t opposite(size_t side)
+{
+    return (side + 2) % Side::max;
+}
+
+/**
+ * Get number of possible rotations.
+ * @param domain set of rotations
+ * @return number of bits set
+ */
+static inline size_t count(uint8_t domain)
+{
+    size_t num = 0;
+    for (; domain; domain &= domain - 1) {
+        ++num;
+    }
+    return num;
+}
+
+Solver::Solver(const Level& level)
+    : guesses(0)
+    , level(level)
+    , pipes(0)
+{
+    const size_t total = level.cells.size();
+    neighbors.resize(total * Side::max);
+    masks.resize(total * Side::max);
+
+    Position pos;
+    for (pos.y = 0; pos.y < level.height; ++pos.y) {
+        for (pos.x = 0; pos.x < level.width; ++pos.x) {
+            const size_t index = pos.y * level.width + pos.x;
+
+            for (size_t side = 0; side < Side::max; ++side) {
+                const Side::Type type = static_cast<Side::Type>(side);
+                const Position next = level.neighbor(pos, type);
+                neighbors[index * Side::max + side] =
+                    next == pos ? none : next.y * level.width + next.x;
+            }
+
+            // origin is the state after all pending rotations are finished:
+            // the pipe is already turned by the first one, the second
+            // (double click) is only scheduled
+            Pipe pipe = level.cells[index].pipe;
+            const Rotation* rotation = level.get_rotation(pos);
+            if (rotation && rotation->twice) {
+                pipe.rotate(rotation->clockwise);
+            }
+            if (pipe != Pipe::None) {
+                ++pipes;
+            }
+            for (size_t turn = 0; turn < Side::max; ++turn) {
+                masks[index * Side::max + turn] = pipe.sides;
+                pipe.rotate(true);
+            }
+        }
+    }
+}
+
+bool Solver::solve()
+{
+    const size_t total = level.cells.size();
+
+    guesses = 0;
+    turns.clear();
+    trail.clear();
+
+    // initial domains: all distinct rotations, the shortest turn first,
+    // locked cells keep the current state
+    domains.resize(total);
+    for (size_t i = 0; i < total; ++i) {
+        if (level.cells[i].locked) {
+            domains[i] = 1;
+            continue;
+        }
+        const uint8_t* mask = &masks[i * Side::max];
+        uint8_t domain = 0;
+        for (size_t turn = 0; turn < Side::max; ++turn) {
+            bool unique = true;
+            for (size_t prev = 0; prev < turn && unique; ++prev) {
+                unique = mask[prev] != mask[turn];
+            }
+            if (unique) {
+                domain |= 1 << turn;
+            }
+        }
+        domains[i] = domain;
+    }
+
+    queue.clear();
+    queue.reserve(total);
+    queued.assign(total, false);
+    for (size_t i = 0; i < total; ++i) {
+        queue.push_back(i);
+        queued[i] = true;
+    }
+
+    parent.resize(total);
+    size.resize(total);
+    open.resize(total);
+
+    // two dead ends can't be connected to each other
+    if (pipes > 2) {
+        for (size_t i = 0; i < total; ++i) {
+            if (level.cells[i].pipe != Pipe::Half) {
+                continue;
+            }
+            for (size_t side = 0; side < Side::max; ++side) {
+                const size_t next = neighbors[i * Side::max + side];
+                if (next != none && level.cells[next].pipe == Pipe::Half &&
+                    !restrict(i, side, false)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    if (!search()) {
+        return false;
+    }
+
+    turns.resize(total);
+    for (size_t i = 0; i < total; ++i) {
+        uint8_t turn = 0;
+        while (!(domains[i] & (1 << turn))) {
+            ++turn;
+        }
+        turns[i] = turn;
+    }
+
+    return true;
+}
+
+const std::vector<uint8_t>& Solver::solution() const
+{
+    return turns;
+}
+
+void Solver::assign(size_t index, uint8_t domain)
+{
+    trail.push_back({ index, domains[index] });
+    domains[index] = domain;
+    if (!queued[index]) {
+        queue.push_back(index);
+        queued[index] = true;
+    }
+}
+
+void Solver::undo(size_t mark)
+{
+    while (trail.size() > mark) {
+        const Change& change = trail.back();
+        domains[change.index] = change.domain;
+        trail.pop_back();
+    }
+    for (const size_t index : queue) {
+        queued[index] = false;
+    }
+    queue.clear();
+}
+
+Solver::Link Solver::link(size_t index, size_t side) const
+{
+    const uint8_t* mask = &masks[index * Side::max];
+    const uint8_t domain = domains[index];
+    const uint8_t bit = 1 << side;
+    bool on = false;
+    bool off = false;
+
+    for (size_t turn = 0; turn < Side::max; ++turn) {
+        if (domain & (1 << turn)) {
+            if (mask[turn] & bit) {
+                on = true;
+            } else {
+                off = true;
+            }
+        }
+    }
+
+    return on && off ? Undefined : (on ? On : Off);
+}
+
+bool Solver::restrict(size_t index, size_t side, bool on)
+{
+    const uint8_t* mask = &masks[index * Side::max];
+    const uint8_t bit = 1 << side;
+    uint8_t domain = domains[index];
+
+    for (size_t turn = 0; turn < Side::max; ++turn) {
+        if ((domain & (1 << turn)) && !(mask[turn] & bit) == on) {
+            domain &= ~(1 << turn);
+        }
+    }
+
+    if (!domain) {
+        return false;
+    }
+    if (domain != domains[index]) {
+        assign(index, domain);
+    }
+
+    return true;
+}
+
+bool Solver::propagate()
+{
+    while (!queue.empty()) {
+        const size_t index = queue.back();
+        queue.pop_back();
+        queued[index] = false;
+
+        for (size_t side = 0; side < Side::max; ++side) {
+            const Link state = link(index, side);
+            const size_t next = neighbors[index * Side::max + side];
+            if (next == none) {
+                // no neighbor: pipe can't be directed to the border
+                if (state != Off && !restrict(index, side, false)) {
+                    return false;
+                }
+            } else if (state != Undefined &&
+                       !restrict(next, opposite(side), state == On)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool Solver::check_network(bool& changed)
+{
+    const size_t total = level.cells.size();
+
+    for (size_t i = 0; i < total; ++i) {
+        parent[i] = i;
+        size[i] = 1;
+        open[i] = 0;
+    }
+
+    // join cells with fixed links, each link is checked once (right/bottom)
+    for (size_t i = 0; i < total; ++i) {
+        for (const size_t side : { Side::Right, Side::Bottom }) {
+            const size_t next = neighbors[i * Side::max + side];
+            if (next == none || link(i, side) != On) {
+                continue;
+            }
+            size_t first = find(i);
+            size_t second = find(next);
+            if (first == second) {
+                return false; // loop
+            }
+            if (size[first] < size[second]) {
+                std::swap(first, second);
+            }
+            parent[second] = first;
+            size[first] += size[second];
+        }
+    }
+
+    // count undefined links of each part, break links that make loops
+    for (size_t i = 0; i < total; ++i) {
+        for (const size_t side : { Side::Right, Side::Bottom }) {
+            const size_t next = neighbors[i * Side::max + side];
+            if (next == none || link(i, side) != Undefined) {
+                continue;
+            }
+            const size_t first = find(i);
+            const size_t second = find(next);
+            if (first == second) {
+                if (!restrict(i, side, false) ||
+                    !restrict(next, opposite(side), false)) {
+                    return false;
+                }
+                changed = true;
+            } else {
+                ++open[first];
+                ++open[second];
+            }
+        }
+    }
+
+    if (changed) {
+        return true; // parts are not actual anymore
+    }
+
+    // closed part must contain all pipes
+    for (size_t i = 0; i < total; ++i) {
+        if (parent[i] == i && !open[i] && masks[i * Side::max] &&
+            size[i] != pipes) {
+            return false;
+        }
+    }
+
+    // two parts with single undefined link can't be connected to each other
+    // unless they are the last ones
+    for (size_t i = 0; i < total; ++i) {
+        for (const size_t side : { Side::Right, Side::Bottom }) {
+            const size_t next = neighbors[i * Side::max + side];
+            if (next == none || link(i, side) != Undefined) {
+                continue;
+            }
+            const size_t first = find(i);
+            const size_t second = find(next);
+            if (first != second && open[first] == 1 && open[second] == 1 &&
+                size[first] + size[second] != pipes) {
+                if (!restrict(i, side, false) ||
+                    !restrict(next, opposite(side), false)) {
+                    return false;
+                }
+                changed = true;
+            }
+        }
+    }
+
+    return true;
+}
+
+size_t Solver::find(size_t index)
+{
+    while (parent[index] != index) {
+        parent[index] = parent[parent[index]];
+        index = parent[index];
+    }
+    return index;
+}
+
+bool Solver::search()
+{
+    // reduce domains until nothing changed
+    bool changed;
+    do {
+        changed = false;
+        if (!propagate() || !check_network(changed)) {
+            return false;
+        }
+    } while (changed);
+
+    // select the most constrained cell
+    size_t guess = none;
+    size_t min_count = Side::max + 1;
+    for (size_t i = 0; i < domains.size() && min_count > 2; ++i) {
+        const size_t num = count(domains[i]);
+        if (num > 1 && num < min_count) {
+            guess = i;
+            min_count = num;
+        }
+    }
+    if (guess == none) {
+        return true; // all cells are fixed
+    }
+
+    // try each rotation, changes made by the wrong guess are undone
+    const uint8_t domain = domains[guess];
+    const size_t mark = trail.size();
+    for (size_t turn = 0; turn < Side::max; ++turn) {
+        const uint8_t bit = 1 << turn;
+        if (!(domain & bit)) {
+            continue;
+        }
+        ++guesses;
+        assign(guess, bit);
+        if (search()) {
+            return true;
+        }
+        undo(mark);
+    }
+
+    return false;
+}
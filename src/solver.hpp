@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: MIT
+// Level solver.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#pragma once
+
+#include "level.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Level solver: finds orientation of pipes that connects all cells into a
+ * single network without loops and open ends, so all receivers are
+ * connected to the sender. Locked cells are not rotated.
+ * Each cell has a set of possible rotations (bit mask), the sets are reduced
+ * by constraint propagation, backtracking is used only if propagation stuck.
+ * Changes of the sets are recorded to the trail to undo wrong guesses.
+ */
+class Solver {
+public:
+    /**
+     * Constructor.
+     * @param level level to solve, current pipe state (including pending
+     *              rotations) is used as origin
+     */
+    Solver(const Level& level);
+
+    /**
+     * Solve the level.
+     * @return false if level has no solution
+     */
+    bool solve();
+
+    /**
+     * Get solution: number of clockwise rotations for each cell.
+     * @return array of rotations (0-3), indexed as Level::cells
+     */
+    const std::vector<uint8_t>& solution() const;
+
+    size_t guesses; ///< Number of guesses made by the last solve()
+
+private:
+    /** Cell states are set of possible rotations, bit per rotation. */
+    using Domains = std::vector<uint8_t>;
+
+    /** Recorded change of the cell state. */
+    struct Change {
+        size_t index;   ///< Cell index
+        uint8_t domain; ///< Previous set of rotations
+    };
+
+    /** Value of the link between two cells. */
+    enum Link {
+        Off,      ///< Sides are not connected
+        On,       ///< Sides are connected
+        Undefined ///< Both variants are possible
+    };
+
+    /**
+     * Get link state of the cell side.
+     * @param index cell index
+     * @param side side of the cell
+     * @return link state
+     */
+    Link link(size_t index, size_t side) const;
+
+    /**
+     * Set possible rotations of the cell, the change is recorded to the trail.
+     * @param index cell index
+     * @param domain new set of rotations
+     */
+    void assign(size_t index, uint8_t domain);
+
+    /**
+     * Restore cell states recorded after the specified trail position.
+     * @param mark position in the trail
+     */
+    void undo(size_t mark);
+
+    /**
+     * Remove rotations that are not compatible with the link state.
+     * @param index cell index
+     * @param side side of the cell
+     * @param on required link state
+     * @return false if no rotations left
+     */
+    bool restrict(size_t index, size_t side, bool on);
+
+    /**
+     * Reduce sets of rotations until the fixed point is reached.
+     * @return false if level has no solution
+     */
+    bool propagate();
+
+    /**
+     * Check network topology: forbid loops and isolated parts.
+     * @param changed output flag, set if some rotations were removed
+     * @return false if level has no solution
+     */
+    bool check_network(bool& changed);
+
+    /**
+     * Find root of the disjoint set.
+     * @param index cell index
+     * @return index of the root cell
+     */
+    size_t find(size_t index);
+
+    /**
+     * Search for solution: propagate constraints and make a guess.
+     * @return true if solution was found
+     */
+    bool search();
+
+    const Level& level; ///< Level to solve
+
+    size_t pipes;                  ///< Number of cells with pipes
+    std::vector<size_t> neighbors; ///< Neighbor indices, 4 per cell
+    std::vector<uint8_t> masks;    ///< Pipe sides for each rotation, 4 per cell
+    Domains domains;               ///< Possible rotations of each cell
+    std::vector<Change> trail;     ///< Changes of domains for backtracking
+
+    std::vector<size_t> queue;  ///< Cells to revise
+    std::vector<bool> queued;   ///< Cell is in queue
+    std::vector<size_t> parent; ///< Disjoint set: parent cell
+    std::vector<size_t> size;   ///< Disjoint set: number of cells
+    std::vector<size_t> open;   ///< Disjoint set: number of undefined links
+
+    std::vector<uint8_t> turns; ///< Solution
+};
@@ -8,38 +8,76 @@
 
 #include <SDL2/SDL.h>
 
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <string>
 
-Sound::~Sound()
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Mix samples with saturation.
+ * @param dst destination buffer
+ * @param src samples to add
+ * @param count number of samples
+ */
+static void mix(int16_t* dst, const int16_t* src, size_t count)
 {
-    for (size_t i = 0; i < sizeof(waves) / sizeof(waves[0]); ++i) {
-        if (waves[i].data) {
-            SDL_FreeWAV(waves[i].data);
-        }
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    for (; i + 8 <= count; i += 8) {
+        __m128i* out = reinterpret_cast<__m128i*>(dst + i);
+        const __m128i in =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(out, _mm_adds_epi16(_mm_loadu_si128(out), in));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= count; i += 8) {
+        vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        const int sum = dst[i] + src[i];
+        dst[i] = std::max(INT16_MIN, std::min(INT16_MAX, sum));
     }
 }
 
-bool Sound::initialize()
+/**
+ * Buffer sizes (in samples) to try, from the lowest latency: 6, 12 and 23 ms
+ * at 44.1 kHz. The next size is used if the device doesn't accept the
+ * current one or underruns are detected.
+ */
+static const uint16_t buffer_sizes[] = { 256, 512, 1024 };
+/** Number of underruns that make the buffer size unstable. */
+static constexpr uint32_t max_underruns = 3;
+/**
+ * Max gap between callbacks in buffer durations, some backends request two
+ * buffers at once and then wait for two buffer durations.
+ */
+static constexpr uint64_t max_gap = 3;
+
+Sound::~Sound()
 {
-    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
-        return false;
+    if (device) {
+        SDL_CloseAudioDevice(device);
     }
+}
 
-    SDL_AudioSpec as;
-    memset(&as, 0, sizeof(as));
-    as.freq = 44100;
-    as.format = AUDIO_S16;
-    as.channels = 2;
-    as.samples = 512;
-    as.callback = &Sound::feed;
-    as.userdata = this;
-    if (SDL_OpenAudio(&as, nullptr) != 0) {
+bool Sound::initialize()
+{
+    // mixer works with 16-bit samples, other parameters are up to device
+    const int allow =
+        SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE;
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0 || !open(0, allow)) {
         return false;
     }
 
-    SDL_PauseAudio(1); // set pause
-
     // load wave files
     if (!load(APP_DATADIR)) {
         // try portable variant
@@ -52,18 +90,100 @@ bool Sound::initialize()
         }
     }
 
-    return waves[0].data && waves[1].data;
+    // the device is never paused: silence is produced if nothing is played
+    SDL_PauseAudioDevice(device, 0);
+
+    return !waves[0].data.empty() && !waves[1].data.empty();
 }
 
 void Sound::play(Sound::Type type)
 {
-    if (enable) {
-        position = 0;
-        current = &waves[type];
-        if (current->data) {
-            SDL_PauseAudio(0);
+    if (enable && !waves[type].data.empty()) {
+        const size_t pos = head.load(std::memory_order_relaxed);
+        if (pos - tail.load(std::memory_order_acquire) < queue_size) {
+            Request& request = requests[pos % queue_size];
+            request.type = type;
+            request.time = SDL_GetPerformanceCounter();
+            head.store(pos + 1, std::memory_order_release);
+        }
+    }
+}
+
+void Sound::update()
+{
+    const size_t sizes_num = sizeof(buffer_sizes) / sizeof(buffer_sizes[0]);
+    if (!device || underruns.load() < max_underruns ||
+        buffer_index + 1 >= sizes_num) {
+        return;
+    }
+
+    // the callback is not running after the device is closed
+    SDL_CloseAudioDevice(device);
+    device = 0;
+
+    // waves are already converted, so the format must not be changed
+    const size_t prev = buffer_index;
+    if (open(buffer_index + 1, 0)) {
+        printf("Audio underruns detected, buffer size is set to %u samples\n",
+               spec.samples);
+    } else if (open(prev, 0)) {
+        buffer_index = sizes_num - 1; // larger buffers are not supported
+    } else {
+        printf("Unable to reopen audio device: %s\n", SDL_GetError());
+        return;
+    }
+    SDL_PauseAudioDevice(device, 0);
+}
+
+bool Sound::open(size_t first, int allow)
+{
+    SDL_AudioSpec desired;
+    memset(&desired, 0, sizeof(desired));
+    desired.freq = spec.freq ? spec.freq : 44100;
+    desired.format = AUDIO_S16SYS;
+    desired.channels = spec.channels ? spec.channels : 2;
+    desired.callback = &Sound::feed;
+    desired.userdata = this;
+
+    // the exact buffer size is requested, so the device doesn't replace it
+    // with its own default
+    const size_t sizes_num = sizeof(buffer_sizes) / sizeof(buffer_sizes[0]);
+    for (size_t i = first; i < sizes_num; ++i) {
+        SDL_AudioSpec obtained;
+        desired.samples = buffer_sizes[i];
+        device = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, allow);
+        if (device) {
+            spec = obtained;
+            buffer_index = i;
+            buffer_time =
+                static_cast<uint64_t>(spec.samples) * 1000000 / spec.freq;
+            last_feed = 0;
+            underruns = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Sound::start(Type type)
+{
+    Voice* voice = nullptr;
+    size_t min_remain = 0;
+    for (Voice& it : voices) {
+        if (!it.wave) {
+            voice = &it;
+            break;
+        }
+        const size_t remain =
+            it.wave->data.size() / sizeof(int16_t) - it.position;
+        if (!voice || remain < min_remain) {
+            voice = &it;
+            min_remain = remain;
         }
     }
+    voice->wave = &waves[type];
+    voice->position = 0;
 }
 
 bool Sound::load(const char* dir)
@@ -71,8 +191,9 @@ bool Sound::load(const char* dir)
     bool rc = true;
 
     for (size_t i = 0; i < sizeof(waves) / sizeof(waves[0]); ++i) {
-        SDL_AudioSpec spec;
-        Uint32 len;
+        SDL_AudioSpec wav_spec;
+        Uint8* wav_data;
+        Uint32 wav_len;
         std::string file = dir;
         switch (i) {
             case Clatz:
@@ -82,9 +203,35 @@ bool Sound::load(const char* dir)
                 file += "complete.wav";
                 break;
         }
-        if (SDL_LoadWAV(file.c_str(), &spec, &waves[i].data, &len)) {
-            waves[i].size = len;
-            rc |= true;
+        if (!SDL_LoadWAV(file.c_str(), &wav_spec, &wav_data, &wav_len)) {
+            rc = false;
+            continue;
+        }
+
+        // convert to the device format once, the mixer only adds samples
+        SDL_AudioCVT cvt;
+        if (SDL_BuildAudioCVT(&cvt, wav_spec.format, wav_spec.channels,
+                              wav_spec.freq, spec.format, spec.channels,
+                              spec.freq) < 0) {
+            SDL_FreeWAV(wav_data);
+            rc = false;
+            continue;
+        }
+        std::vector<uint8_t>& data = waves[i].data;
+        data.resize(wav_len * cvt.len_mult);
+        memcpy(data.data(), wav_data, wav_len);
+        SDL_FreeWAV(wav_data);
+        if (cvt.needed) {
+            cvt.buf = data.data();
+            cvt.len = wav_len;
+            if (SDL_ConvertAudio(&cvt) != 0) {
+                data.clear();
+                rc = false;
+                continue;
+            }
+            data.resize(cvt.len_cvt);
+        } else {
+            data.resize(wav_len);
         }
     }
 
@@ -94,14 +241,51 @@ bool Sound::load(const char* dir)
 void Sound::feed(void* userdata, uint8_t* stream, int len)
 {
     Sound* snd = reinterpret_cast<Sound*>(userdata);
-    Wave& wav = *snd->current;
 
-    const size_t remain = wav.size - snd->position;
-    const Uint32 write = remain < static_cast<Uint32>(len) ? remain : len;
+    // the callback is called once per buffer, a longer gap means that the
+    // device was starving
+    const uint64_t now = SDL_GetPerformanceCounter();
+    if (snd->last_feed) {
+        const uint64_t gap =
+            (now - snd->last_feed) * 1000000 / SDL_GetPerformanceFrequency();
+        if (gap > snd->buffer_time * max_gap) {
+            ++snd->underruns;
+        }
+    }
+    snd->last_feed = now;
+
+    // start requested sounds
+    size_t pos = snd->tail.load(std::memory_order_relaxed);
+    const size_t end = snd->head.load(std::memory_order_acquire);
+    if (pos != end) {
+        // the first mixed buffer is completely played after one buffer time
+        const Request& last = snd->requests[(end - 1) % queue_size];
+        const uint64_t wait =
+            (now - last.time) * 1000000 / SDL_GetPerformanceFrequency();
+        snd->last_estimate = static_cast<uint32_t>(wait + snd->buffer_time);
+    }
+    while (pos != end) {
+        snd->start(snd->requests[pos % queue_size].type);
+        ++pos;
+    }
+    snd->tail.store(pos, std::memory_order_release);
+
+    // mix all active voices
+    int16_t* out = reinterpret_cast<int16_t*>(stream);
+    const size_t samples = len / sizeof(int16_t);
     memset(stream, 0, len);
-    SDL_MixAudio(stream, &wav.data[snd->position], write, SDL_MIX_MAXVOLUME);
-    snd->position += write;
-    if (snd->position >= wav.size) {
-        SDL_PauseAudio(1); // wave played, make pause
+    for (Voice& voice : snd->voices) {
+        if (!voice.wave) {
+            continue;
+        }
+        const int16_t* data =
+            reinterpret_cast<const int16_t*>(voice.wave->data.data());
+        const size_t total = voice.wave->data.size() / sizeof(int16_t);
+        const size_t count = std::min(samples, total - voice.position);
+        mix(out, data + voice.position, count);
+        voice.position += count;
+        if (voice.position >= total) {
+            voice.wave = nullptr; // wave played, release the voice
+        }
     }
 }
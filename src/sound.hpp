@@ -4,10 +4,18 @@
 
 #pragma once
 
+#include <SDL2/SDL.h>
+
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
-/** Sound subsystem. */
+/**
+ * Sound subsystem.
+ * Sounds are mixed by the audio thread from the pool of voices, the game
+ * thread only puts requests to the lock-free queue.
+ */
 class Sound {
 public:
     ~Sound();
@@ -25,16 +33,41 @@ public:
     bool initialize();
 
     /**
-     * Play specified sound.
+     * Play specified sound, doesn't interrupt sounds already played.
      * @param type sound to play
      */
     void play(Type type);
 
+    /**
+     * Check the device: reopen it with a larger buffer if the audio
+     * callback was late too often (buffer underruns).
+     */
+    void update();
+
+    /**
+     * Get estimated output latency of the last played sound: time the
+     * request waited in the queue plus duration of one device buffer.
+     * This is not a measurement, buffering inside the audio driver is not
+     * included.
+     * @return latency estimate in microseconds, 0 if nothing was played yet
+     */
+    uint64_t latency_estimate() const { return last_estimate.load(); }
+
     bool enable = true; ///< Sound enable/disable
 
 private:
     /**
-     * Load sound files from the specified directory.
+     * Open audio device with the smallest buffer size that is accepted by
+     * the device.
+     * @param first index of the first buffer size to try
+     * @param allow allowed changes of the device format
+     * @return false if device can not be opened
+     */
+    bool open(size_t first, int allow);
+
+    /**
+     * Load sound files from the specified directory and convert them to
+     * the device format.
      * @param dir path to directory with sound files (wav)
      * @return false if load failed
      */
@@ -43,12 +76,50 @@ private:
     /** Callback that feeds the audio device. */
     static void feed(void* userdata, uint8_t* stream, int len);
 
+    /**
+     * Start playing sound on a free voice, called from the audio thread.
+     * If all voices are busy, the one closest to the end is reused.
+     * @param type sound to play
+     */
+    void start(Type type);
+
     struct Wave {
-        uint8_t* data; ///< Plain wave data
-        size_t size;   ///< Size of wave data
+        std::vector<uint8_t> data; ///< Wave data in the device format
+    };
+    Wave waves[2];
+
+    /** Voice: currently played wave. */
+    struct Voice {
+        const Wave* wave; ///< Played wave, nullptr if the voice is free
+        size_t position;  ///< Current played position in samples
+    };
+
+    /** Request to play sound. */
+    struct Request {
+        Type type;     ///< Sound to play
+        uint64_t time; ///< Request time (performance counter)
     };
-    Wave waves[2] = {};
 
-    Wave* current;   ///< Currently played wave
-    size_t position; ///< Current played position
+    /** Max number of simultaneously played sounds. */
+    static constexpr size_t max_voices = 8;
+    /** Capacity of the request queue. */
+    static constexpr size_t queue_size = 16;
+
+    SDL_AudioDeviceID device = 0; ///< Audio device
+    SDL_AudioSpec spec = {};      ///< Audio device format
+    size_t buffer_index = 0;      ///< Index of the current buffer size
+    uint64_t buffer_time = 0;     ///< Duration of the device buffer in us
+
+    // underrun detection: the callback is called late
+    uint64_t last_feed = 0;               ///< Last callback time (counter)
+    std::atomic<uint32_t> underruns{ 0 }; ///< Number of late callbacks
+
+    Voice voices[max_voices] = {}; ///< Voice pool, used by audio thread only
+
+    // single producer (game thread), single consumer (audio thread) queue
+    Request requests[queue_size];  ///< Sounds to start
+    std::atomic<size_t> head{ 0 }; ///< Number of queued requests
+    std::atomic<size_t> tail{ 0 }; ///< Number of started requests
+
+    std::atomic<uint32_t> last_estimate{ 0 }; ///< Latency estimate in us
 };
@@ -6,13 +6,29 @@
 
 #include <SDL2/SDL.h>
 
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <vector>
 
 #include "level.hpp"
 
 static const char* app_name = "pipewalker";
-static const char* state_file = "pipewalker.ini";
+static const char* state_file = "pipewalker.sav";
+static const char* ini_file = "pipewalker.ini";
 
 static const char* key_id = "id";
 static const char* key_width = "width";
@@ -22,7 +38,217 @@ static const char* key_pipes = "pipes";
 static const char* key_skin = "skin";
 static const char* key_sound = "sound";
 
-/** INI file reader/writer. */
+// Binary state file layout (little endian):
+//   signature   4 bytes, "PWST"
+//   version     1 byte
+//   flags       1 byte, bit 0: wrap mode, bit 1: sound
+//   width       1 byte
+//   height      1 byte
+//   id          4 bytes
+//   skin        1 byte length + name
+//   cells       2 bytes, number of cells, 0 if pipes are not saved
+//   sides       4 bits per cell, two cells per byte, first in low bits
+//   locks       1 bit per cell
+//   moves       2 bytes, number of moves in the journal (since version 2)
+//   position    2 bytes, number of moves that can be undone (since version 2)
+//   journal     2 bytes per move (since version 2)
+//   checksum    4 bytes, CRC-32 of all previous bytes
+static const uint8_t signature[] = { 'P', 'W', 'S', 'T' };
+static constexpr uint8_t version = 2;
+static constexpr uint8_t flag_wrap = 1 << 0;
+static constexpr uint8_t flag_sound = 1 << 1;
+static constexpr uint8_t lock_bit = 1 << 4;
+
+/** Max size of the state file. */
+static constexpr size_t max_file_size = 64 * 1024;
+
+/**
+ * Get path to the file inside the user's preferences directory.
+ * @param file file name
+ * @return full path, empty string on errors
+ */
+static std::string pref_path(const char* file)
+{
+    std::string path;
+    char* dir = SDL_GetPrefPath(nullptr, app_name);
+    if (dir) {
+        path = dir;
+        path += file;
+        SDL_free(dir);
+    }
+    return path;
+}
+
+/**
+ * Calculate CRC-32 checksum.
+ * @param data data to check
+ * @param size size of data in bytes
+ * @return checksum
+ */
+static uint32_t crc32(const uint8_t* data, size_t size)
+{
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; ++i) {
+        crc ^= data[i];
+        for (size_t bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+/** Read-only file mapped to memory. */
+class MappedFile {
+public:
+    MappedFile(const std::string& path)
+        : data(nullptr)
+        , size(0)
+    {
+#ifdef _WIN32
+        // no mmap: read the whole file
+        SDL_RWops* io = SDL_RWFromFile(path.c_str(), "rb");
+        if (io) {
+            const Sint64 sz = SDL_RWsize(io);
+            if (sz > 0 && static_cast<size_t>(sz) <= max_file_size) {
+                buffer.resize(sz);
+                if (SDL_RWread(io, buffer.data(), 1, sz) ==
+                    static_cast<size_t>(sz)) {
+                    data = buffer.data();
+                    size = sz;
+                }
+            }
+            SDL_RWclose(io);
+        }
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+                static_cast<size_t>(st.st_size) <= max_file_size) {
+                void* ptr =
+                    mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (ptr != MAP_FAILED) {
+                    data = static_cast<const uint8_t*>(ptr);
+                    size = st.st_size;
+                }
+            }
+            close(fd);
+        }
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (data) {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+#endif
+    }
+
+    const uint8_t* data; ///< File content
+    size_t size;         ///< File size
+
+#ifdef _WIN32
+private:
+    std::vector<uint8_t> buffer; ///< File content
+#endif
+};
+
+/** Bounds checked reader of binary data. */
+struct BinaryReader {
+    /**
+     * Read little endian integer.
+     * @param value output value
+     * @param bytes size of the value in bytes
+     * @return false if there is not enough data
+     */
+    bool get(uint32_t& value, size_t bytes)
+    {
+        if (static_cast<size_t>(end - pos) < bytes) {
+            return false;
+        }
+        value = 0;
+        for (size_t i = 0; i < bytes; ++i) {
+            value |= static_cast<uint32_t>(*pos++) << (i * 8);
+        }
+        return true;
+    }
+
+    /**
+     * Skip data block.
+     * @param bytes size of the block
+     * @return pointer to the block, nullptr if there is not enough data
+     */
+    const uint8_t* take(size_t bytes)
+    {
+        if (static_cast<size_t>(end - pos) < bytes) {
+            return nullptr;
+        }
+        const uint8_t* block = pos;
+        pos += bytes;
+        return block;
+    }
+
+    const uint8_t* pos; ///< Current position
+    const uint8_t* end; ///< End of data
+};
+
+/**
+ * Append little endian integer to the buffer.
+ * @param buffer output buffer
+ * @param value value to write
+ * @param bytes size of the value in bytes
+ */
+static void put(std::vector<uint8_t>& buffer, uint32_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i) {
+        buffer.push_back(static_cast<uint8_t>(value >> (i * 8)));
+    }
+}
+
+/**
+ * Write file atomically: write the temporary file and replace the target.
+ * @param path path to the file
+ * @param data file content
+ * @return false on errors
+ */
+static bool write_file(const std::string& path,
+                       const std::vector<uint8_t>& data)
+{
+    const std::string tmp = path + ".tmp";
+
+    FILE* file = fopen(tmp.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    bool rc = fwrite(data.data(), 1, data.size(), file) == data.size() &&
+        fflush(file) == 0;
+#ifdef _WIN32
+    rc = rc && _commit(_fileno(file)) == 0;
+#else
+    rc = rc && fsync(fileno(file)) == 0;
+#endif
+    rc = (fclose(file) == 0) && rc;
+    if (!rc) {
+        remove(tmp.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    rc = MoveFileExA(tmp.c_str(), path.c_str(),
+                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+    rc = rename(tmp.c_str(), path.c_str()) == 0;
+#endif
+    if (!rc) {
+        remove(tmp.c_str());
+    }
+
+    return rc;
+}
+
+/** INI file reader, used to import state of previous versions. */
 class IniFile {
 public:
     struct KeyValue {
@@ -30,16 +256,12 @@ public:
         std::string value;
     };
 
-    IniFile(bool readonly)
+    IniFile()
         : io(nullptr)
     {
-        char* dir = SDL_GetPrefPath(nullptr, app_name);
-        if (dir) {
-            std::string path = dir;
-            path += state_file;
-            SDL_free(dir);
-
-            io = SDL_RWFromFile(path.c_str(), readonly ? "rb" : "wb");
+        const std::string path = pref_path(ini_file);
+        if (!path.empty()) {
+            io = SDL_RWFromFile(path.c_str(), "rb");
         }
     }
 
@@ -50,20 +272,15 @@ public:
         }
     }
 
-    /** Write key-value. */
-    bool write(const char* name, const std::string& value)
-    {
-        return SDL_RWwrite(io, name, strlen(name), 1) &&
-            SDL_RWwrite(io, "=", 1, 1) &&
-            SDL_RWwrite(io, value.c_str(), 1, value.length()) &&
-            SDL_RWwrite(io, "\n", 1, 1);
-    }
-
     /** Read key-value array. */
     std::vector<KeyValue> read()
     {
         std::vector<KeyValue> settings;
-        std::vector<char> buffer(Level::max_size * Level::max_size + 128, 0);
+        const Sint64 size = SDL_RWsize(io);
+        if (size <= 0 || static_cast<size_t>(size) > max_file_size) {
+            return settings;
+        }
+        std::vector<char> buffer(size, 0);
 
         const size_t rd = SDL_RWread(io, &buffer[0], 1, buffer.size());
 
@@ -92,35 +309,200 @@ public:
     SDL_RWops* io;
 };
 
+/**
+ * Parse decimal number.
+ * @param text string to parse
+ * @param min,max range of valid values
+ * @param value output number
+ * @return false if text is not a number or it is out of range
+ */
+static bool parse_number(const std::string& text, long min, long max,
+                         long& value)
+{
+    const char* str = text.c_str();
+    char* end = nullptr;
+    errno = 0;
+    const long num = strtol(str, &end, 10);
+    if (end == str) {
+        return false;
+    }
+    while (isspace(static_cast<unsigned char>(*end))) {
+        ++end; // CR of DOS line endings
+    }
+    if (*end || errno || num < min || num > max) {
+        return false;
+    }
+    value = num;
+    return true;
+}
+
 bool State::load()
 {
-    IniFile ini(true);
+    return load_binary() || load_ini();
+}
+
+bool State::save() const
+{
+    const std::string path = pref_path(state_file);
+    if (path.empty()) {
+        return false;
+    }
+
+    const size_t cells = level_pipes.size();
+    const size_t skin_len = std::min<size_t>(skin.length(), 0xff);
+
+    std::vector<uint8_t> data(signature, signature + sizeof(signature));
+    put(data, version, 1);
+    put(data, (level_wrap ? flag_wrap : 0) | (sound ? flag_sound : 0), 1);
+    put(data, level_width, 1);
+    put(data, level_height, 1);
+    put(data, level_id, 4);
+    put(data, skin_len, 1);
+    data.insert(data.end(), skin.begin(), skin.begin() + skin_len);
+    put(data, cells, 2);
+
+    // pack sides and locks
+    const size_t sides_pos = data.size();
+    data.resize(sides_pos + (cells + 1) / 2 + (cells + 7) / 8, 0);
+    uint8_t* sides = &data[sides_pos];
+    uint8_t* locks = sides + (cells + 1) / 2;
+    for (size_t i = 0; i < cells; ++i) {
+        const uint8_t state = level_pipes[i] - 'A';
+        sides[i / 2] |= (state & 0xf) << ((i % 2) * 4);
+        if (state & lock_bit) {
+            locks[i / 8] |= 1 << (i % 8);
+        }
+    }
+
+    put(data, journal.size(), 2);
+    put(data, journal_position, 2);
+    for (const uint16_t move : journal) {
+        put(data, move, 2);
+    }
+
+    put(data, crc32(data.data(), data.size()), 4);
+
+    return write_file(path, data);
+}
+
+bool State::load_binary()
+{
+    const std::string path = pref_path(state_file);
+    if (path.empty()) {
+        return false;
+    }
+    const MappedFile file(path);
+    if (!file.data || file.size < sizeof(signature) + sizeof(uint32_t)) {
+        return false;
+    }
+
+    // checksum covers the whole file except itself
+    BinaryReader rd = { file.data, file.data + file.size };
+    const size_t body = file.size - sizeof(uint32_t);
+    uint32_t checksum;
+    rd.pos += body;
+    if (!rd.get(checksum, 4) || checksum != crc32(file.data, body)) {
+        return false;
+    }
+    rd.pos = file.data;
+    rd.end = file.data + body;
+
+    uint32_t ver, flags, width, height, id, skin_len, cells;
+    const uint8_t* sign = rd.take(sizeof(signature));
+    if (!sign || memcmp(sign, signature, sizeof(signature)) != 0 ||
+        !rd.get(ver, 1) || ver < 1 || ver > version || !rd.get(flags, 1) ||
+        !rd.get(width, 1) || !rd.get(height, 1) || !rd.get(id, 4) ||
+        !rd.get(skin_len, 1)) {
+        return false;
+    }
+    const uint8_t* skin_name = rd.take(skin_len);
+    if (!skin_name || !rd.get(cells, 2)) {
+        return false;
+    }
+    const uint8_t* sides = rd.take((cells + 1) / 2);
+    const uint8_t* locks = rd.take((cells + 7) / 8);
+    if (!sides || !locks) {
+        return false;
+    }
+    uint32_t moves = 0, position = 0;
+    std::vector<uint16_t> history;
+    if (ver >= 2) {
+        if (!rd.get(moves, 2) || !rd.get(position, 2) || position > moves) {
+            return false;
+        }
+        history.resize(moves);
+        for (uint16_t& move : history) {
+            uint32_t value;
+            if (!rd.get(value, 2)) {
+                return false;
+            }
+            move = value;
+        }
+    }
+    if (rd.pos != rd.end) {
+        return false;
+    }
+
+    if (id == 0 || id > Level::max_id || width < Level::min_size ||
+        width > Level::max_size || height < Level::min_size ||
+        height > Level::max_size || (cells && cells != width * height)) {
+        return false;
+    }
+
+    level_id = id;
+    level_width = width;
+    level_height = height;
+    level_wrap = flags & flag_wrap;
+    sound = flags & flag_sound;
+    skin.assign(reinterpret_cast<const char*>(skin_name), skin_len);
+    level_pipes.resize(cells);
+    for (size_t i = 0; i < cells; ++i) {
+        uint8_t state = (sides[i / 2] >> ((i % 2) * 4)) & 0xf;
+        if (locks[i / 8] & (1 << (i % 8))) {
+            state |= lock_bit;
+        }
+        level_pipes[i] = 'A' + state;
+    }
+    journal.swap(history);
+    journal_position = position;
+
+    return true;
+}
+
+bool State::load_ini()
+{
+    IniFile ini;
     if (!ini.io) {
         return false;
     }
 
+    // invalid entries are skipped, defaults are used instead
     for (const auto& it : ini.read()) {
+        long num;
         if (it.key == key_id) {
-            const int id = std::stoi(it.value);
-            if (id > 0 && static_cast<size_t>(id) <= Level::max_id) {
-                level_id = id;
+            if (parse_number(it.value, 1, Level::max_id, num)) {
+                level_id = num;
             }
         } else if (it.key == key_width) {
-            const int sz = std::stoi(it.value);
-            if (sz > 0 && static_cast<size_t>(sz) <= Level::max_size) {
-                level_width = sz;
+            if (parse_number(it.value, Level::min_size, Level::max_size,
+                             num)) {
+                level_width = num;
             }
         } else if (it.key == key_height) {
-            const int sz = std::stoi(it.value);
-            if (sz > 0 && static_cast<size_t>(sz) <= Level::max_size) {
-                level_height = sz;
+            if (parse_number(it.value, Level::min_size, Level::max_size,
+                             num)) {
+                level_height = num;
             }
         } else if (it.key == key_wrap) {
-            level_wrap = std::stoi(it.value);
+            if (parse_number(it.value, 0, 1, num)) {
+                level_wrap = num;
+            }
         } else if (it.key == key_pipes) {
             level_pipes = it.value;
         } else if (it.key == key_sound) {
-            sound = std::stoi(it.value);
+            if (parse_number(it.value, 0, 1, num)) {
+                sound = num;
+            }
         } else if (it.key == key_skin) {
             skin = it.value;
         }
@@ -128,19 +510,3 @@ bool State::load()
 
     return true;
 }
-
-bool State::save() const
-{
-    IniFile ini(false);
-    if (!ini.io) {
-        return false;
-    }
-
-    return ini.write(key_id, std::to_string(level_id)) &&
-        ini.write(key_width, std::to_string(level_width)) &&
-        ini.write(key_height, std::to_string(level_height)) &&
-        ini.write(key_wrap, std::to_string(level_wrap)) &&
-        ini.write(key_pipes, level_pipes) &&
-        ini.write(key_sound, std::to_string(sound)) &&
-        ini.write(key_skin, skin);
-}
@@ -6,26 +6,42 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 /** Game state. */
 struct State {
     /**
      * Load state from external storage.
+     * State saved in INI format by previous versions is supported too.
      * @return true if state was loaded
      */
     bool load();
 
     /**
-     * Save state to external storage.
+     * Save state to external storage (binary format).
      * @return true if state was saved
      */
     bool save() const;
 
+    /**
+     * Load state from binary file.
+     * @return true if state was loaded
+     */
+    bool load_binary();
+
+    /**
+     * Load state from INI file.
+     * @return true if state was loaded
+     */
+    bool load_ini();
+
     uint32_t level_id = 1;
     bool level_wrap = true;
     size_t level_width = 10;
     size_t level_height = 10;
     std::string level_pipes;
+    std::vector<uint16_t> journal;
+    size_t journal_position = 0;
     bool sound = true;
     std::string skin = "Network";
 };
@@ -0,0 +1,253 @@
+// SPDX-License-Identifier: MIT
+// Software renderer tests.
+// Copyright (C) 2024 Artem Senichev <artemsen@gmail.com>
+
+#include <SDL2/SDL.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "blend.hpp"
+#include "canvas.hpp"
+#include "mtrand.hpp"
+
+/**
+ * Max difference of color channel from SDL: SDL truncates intermediate
+ * results while the blending kernels round them.
+ */
+static constexpr int tolerance = 3;
+
+/**
+ * Difference of neighbor texels of the test image: SDL scales and rotates
+ * the image in two passes, so a pixel can be sampled from the neighbor
+ * texel of the one used by the canvas.
+ */
+static constexpr int texel_step = 2;
+
+/**
+ * Compare two pixels.
+ * @param a,b pixels to compare (ARGB)
+ * @param max max difference of color channels
+ * @return true if color channels differ no more than max
+ */
+static bool similar(uint32_t a, uint32_t b, int max)
+{
+    for (size_t i = 0; i < 32; i += 8) {
+        const int ca = (a >> i) & 0xff;
+        const int cb = (b >> i) & 0xff;
+        if (std::abs(ca - cb) > max) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Draw image with the SDL software renderer (SDL_RenderCopyEx) in the same
+ * way as the GPU path does: blending with color and alpha modulation.
+ * @param canvas destination canvas
+ * @param image source image
+ * @param src source rectangle inside the image
+ * @param dst destination position and size (before rotation)
+ * @param angle rotation angle in degrees (clockwise)
+ * @param color color and transparency modulation (ARGB)
+ * @return false if SDL failed
+ */
+static bool sdl_draw(Canvas& canvas, const Canvas& image, const SDL_Rect& src,
+                     const SDL_Rect& dst, double angle, uint32_t color)
+{
+    bool rc = false;
+
+    SDL_Surface* target = SDL_CreateRGBSurfaceWithFormatFrom(
+        canvas.pixels.data(), canvas.width, canvas.height, 32,
+        canvas.width * sizeof(uint32_t), SDL_PIXELFORMAT_ARGB8888);
+    SDL_Surface* source = SDL_CreateRGBSurfaceWithFormatFrom(
+        const_cast<uint32_t*>(image.pixels.data()), image.width, image.height,
+        32, image.width * sizeof(uint32_t), SDL_PIXELFORMAT_ARGB8888);
+    SDL_Renderer* render =
+        target ? SDL_CreateSoftwareRenderer(target) : nullptr;
+    SDL_Texture* texture =
+        render && source ? SDL_CreateTextureFromSurface(render, source)
+                         : nullptr;
+
+    if (texture) {
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        SDL_SetTextureScaleMode(texture, SDL_ScaleModeNearest);
+        SDL_SetTextureColorMod(texture, (color >> 16) & 0xff,
+                               (color >> 8) & 0xff, color & 0xff);
+        SDL_SetTextureAlphaMod(texture, color >> 24);
+        rc = SDL_RenderCopyEx(render, texture, &src, &dst, angle, nullptr,
+                              SDL_FLIP_NONE) == 0 &&
+            SDL_RenderFlush(render) == 0;
+    }
+    if (!rc) {
+        printf("SDL: %s\n", SDL_GetError());
+    }
+
+    if (texture) {
+        SDL_DestroyTexture(texture);
+    }
+    if (render) {
+        SDL_DestroyRenderer(render);
+    }
+    if (source) {
+        SDL_FreeSurface(source);
+    }
+    if (target) {
+        SDL_FreeSurface(target);
+    }
+
+    return rc;
+}
+
+/**
+ * Check SIMD blending against the scalar version and SDL.
+ * @return false if test failed
+ */
+static bool test_blend()
+{
+    MtRand random(1);
+
+    for (size_t iter = 0; iter < 2000; ++iter) {
+        const size_t count = random.get(1, 67);
+        Canvas src;
+        Canvas dst;
+        src.resize(count, 1);
+        dst.resize(count, 1);
+        for (size_t i = 0; i < count; ++i) {
+            src.pixels[i] = random.get();
+            if (random.get(0, 4) == 0) {
+                src.pixels[i] &= 0x00ffffff; // transparent
+            }
+            dst.pixels[i] = random.get() | 0xff000000;
+        }
+        uint32_t color = random.get();
+        if (iter % 3 == 0) {
+            color = 0xffffffff; // no modulation
+        } else if (iter % 3 == 1) {
+            color = 0x4c000000; // shadow
+        }
+
+        std::vector<uint32_t> simd = dst.pixels;
+        std::vector<uint32_t> scalar = dst.pixels;
+        blend(simd.data(), src.pixels.data(), count, color);
+        blend_scalar(scalar.data(), src.pixels.data(), count, color);
+
+        const SDL_Rect rect = { 0, 0, static_cast<int>(count), 1 };
+        if (!sdl_draw(dst, src, rect, rect, 0, color)) {
+            return false;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            if (simd[i] != scalar[i]) {
+                printf("blend: %08x != %08x (blend_scalar)\n", simd[i],
+                       scalar[i]);
+                return false;
+            }
+            if (!similar(scalar[i], dst.pixels[i], tolerance)) {
+                printf("blend: %08x != %08x (SDL)\n", scalar[i],
+                       dst.pixels[i]);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Check image drawing against the SDL software renderer.
+ * @return false if test failed
+ */
+static bool test_draw()
+{
+    MtRand random(2);
+
+    // source image: smooth gradient with transparent border
+    Canvas image;
+    image.resize(64, 64);
+    for (int y = 0; y < image.height; ++y) {
+        for (int x = 0; x < image.width; ++x) {
+            uint32_t pixel = 0xff000000 | ((0x10 + x * texel_step) << 16) |
+                ((0x10 + y * texel_step) << 8) | 0x80;
+            if (x < 4 || y < 4 || x >= 60 || y >= 60) {
+                pixel &= 0x00ffffff;
+            }
+            image.pixels[y * image.width + x] = pixel;
+        }
+    }
+    // odd source size: rotation by right angles maps pixels to pixels
+    const SDL_Rect src = { 16, 8, 33, 33 };
+
+    struct Case {
+        SDL_Rect dst;   ///< Destination rectangle
+        double angle;   ///< Rotation angle
+        uint32_t color; ///< Modulation color
+        bool exact;     ///< Each pixel is sampled in the same way
+    };
+    // clang-format off
+    const Case cases[] = {
+        { { 10, 12, 33, 33 },   0, 0xffffffff, true  },
+        { { 10, 12, 33, 33 },  90, 0xffffffff, true  },
+        { { 10, 12, 33, 33 }, 180, 0xb0ffffff, true  },
+        { { 10, 12, 33, 33 }, 270, 0xff80ff80, true  },
+        { { 10, 12, 48, 48 },  90, 0xffffffff, false },
+        { { 10, 12, 48, 48 }, 180, 0x4c000000, false },
+        { { 10, 12, 24, 24 }, 270, 0xffffffff, false },
+        { { 30, 20, 40, 40 },  30, 0xff80ff80, false },
+        { { -8, -8, 40, 40 }, 137, 0xb0ffffff, false },
+    };
+    // clang-format on
+
+    for (const Case& test : cases) {
+        Canvas expect;
+        expect.resize(96, 80);
+        for (uint32_t& pixel : expect.pixels) {
+            pixel = random.get() | 0xff000000;
+        }
+        Canvas canvas;
+        canvas.resize(expect.width, expect.height);
+        canvas.pixels = expect.pixels;
+
+        canvas.draw(image, src, test.dst, test.angle, test.color, nullptr);
+        if (!sdl_draw(expect, image, src, test.dst, test.angle, test.color)) {
+            return false;
+        }
+
+        // inner pixels can be sampled from the neighbor texel, pixels on
+        // the edges of the image can be covered differently
+        const int max = tolerance + (test.exact ? 0 : texel_step);
+        const size_t max_misses =
+            test.exact ? 0 : 4 * (test.dst.w + test.dst.h);
+        size_t misses = 0;
+        for (size_t i = 0; i < canvas.pixels.size(); ++i) {
+            if (!similar(canvas.pixels[i], expect.pixels[i], max)) {
+                ++misses;
+            }
+        }
+        if (misses > max_misses) {
+            printf("draw: angle %g, size %d: %zu pixels differ\n", test.angle,
+                   test.dst.w, misses);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/** Test entry point. */
+int main()
+{
+    bool rc = true;
+
+    if (!test_blend()) {
+        rc = false;
+    }
+    if (!test_draw()) {
+        rc = false;
+    }
+
+    puts(rc ? "Passed" : "Failed");
+    return rc ? EXIT_SUCCESS : EXIT_FAILURE;
+}